@@ -82,7 +82,7 @@ bool cOglOsdProvider::StartOpenGlThread(void) {
     }
     cCondWait wait;
     dsyslog("[oglosd]Trying to start OpenGL Worker Thread");
-	oglThread.reset(new cOglThread(&wait, pVMed->MaxSizeGPUImageCache()));
+	oglThread.reset(new cOglThread(&wait, pVMed->MaxSizeGPUImageCache(), pVMed->MaxSizeGPUFbMemory(), pVMed->GPUImageStorage(), pVMed->OutputBackend()));
     wait.Wait();
     if (oglThread->Active()) {
         dsyslog("[oglosd]OpenGL Worker Thread successfully started");
@@ -123,4 +123,5 @@ cOglOsdProvider::~cOglOsdProvider()
     dsyslog("[oglosd]%s:\n", __FUNCTION__);
 #endif
     StopOpenGlThread();
+    cOglFaceLoader::Shutdown();
 }
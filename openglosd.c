@@ -1,7 +1,20 @@
 #define __STL_CONFIG_H
 #include <algorithm>
+#include <chrono>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <vdr/device.h>
+#include <vdr/plugin.h>
 
 #include "openglosd.h"
 
@@ -10,6 +23,7 @@ IVdpauMediator * pVMed = nullptr;
 #ifdef USE_GLES2
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 
 /* This is needed for the GLES2 GL_CLAMP_TO_BORDER workaround */
 #define BORDERCOLOR 0x88888888
@@ -62,6 +76,139 @@ void ConvertColor(const GLint &colARGB, glm::vec4 &col) {
     col.b = ((colARGB & 0x000000FF)      ) / 255.0;
 }
 
+/* Bitmaps with at least this many pixels are converted by several threads */
+#define BITMAP_MT_THRESHOLD (512 * 1024)
+#define BITMAP_MAX_THREADS 4
+
+static void ExpandIndexRowScalar(const tIndex *src, tColor *dst, int count, const tColor *palette) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        dst[i    ] = palette[src[i    ]];
+        dst[i + 1] = palette[src[i + 1]];
+        dst[i + 2] = palette[src[i + 2]];
+        dst[i + 3] = palette[src[i + 3]];
+    }
+    for (; i < count; i++)
+        dst[i] = palette[src[i]];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void ExpandIndexRowAvx2(const tIndex *src, tColor *dst, int count, const tColor *palette) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + i)));
+        __m256i argb = _mm256_i32gather_epi32((const int *)palette, index, 4);
+        _mm256_storeu_si256((__m256i *)(dst + i), argb);
+    }
+    ExpandIndexRowScalar(src + i, dst + i, count - i, palette);
+}
+
+/* Without a gather the byte planes are looked up like on NEON, pshufb covers
+   16 entries, picked by the high nibble of the index */
+__attribute__((target("ssse3")))
+static void ExpandIndexRowSsse3(const tIndex *src, tColor *dst, int count, const tColor *palette) {
+    uint8_t planes[4][MAXNUMCOLORS] __attribute__((aligned(16)));
+    for (int c = 0; c < MAXNUMCOLORS; c++)
+        for (int b = 0; b < 4; b++)
+            planes[b][c] = (palette[c] >> (8 * b)) & 0xFF;
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i index = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_and_si128(index, nibble);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(index, 4), nibble);
+        __m128i p[4] = { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+        for (int t = 0; t < MAXNUMCOLORS / 16; t++) {
+            __m128i mask = _mm_cmpeq_epi8(hi, _mm_set1_epi8(t));
+            for (int b = 0; b < 4; b++) {
+                __m128i table = _mm_load_si128((const __m128i *)&planes[b][16 * t]);
+                p[b] = _mm_or_si128(p[b], _mm_and_si128(mask, _mm_shuffle_epi8(table, lo)));
+            }
+        }
+        //interleave the planes back into colors
+        __m128i lo01 = _mm_unpacklo_epi8(p[0], p[1]);
+        __m128i hi01 = _mm_unpackhi_epi8(p[0], p[1]);
+        __m128i lo23 = _mm_unpacklo_epi8(p[2], p[3]);
+        __m128i hi23 = _mm_unpackhi_epi8(p[2], p[3]);
+        _mm_storeu_si128((__m128i *)(dst + i     ), _mm_unpacklo_epi16(lo01, lo23));
+        _mm_storeu_si128((__m128i *)(dst + i +  4), _mm_unpackhi_epi16(lo01, lo23));
+        _mm_storeu_si128((__m128i *)(dst + i +  8), _mm_unpacklo_epi16(hi01, hi23));
+        _mm_storeu_si128((__m128i *)(dst + i + 12), _mm_unpackhi_epi16(hi01, hi23));
+    }
+    ExpandIndexRowScalar(src + i, dst + i, count - i, palette);
+}
+#elif defined(__aarch64__)
+/* NEON has no 32 bit gather, so look up the four bytes of each color separately
+   in byte planes of the palette, 64 entries per table lookup */
+static void ExpandIndexRowNeon(const tIndex *src, tColor *dst, int count, const tColor *palette) {
+    uint8_t planes[4][MAXNUMCOLORS];
+    for (int c = 0; c < MAXNUMCOLORS; c++)
+        for (int b = 0; b < 4; b++)
+            planes[b][c] = (palette[c] >> (8 * b)) & 0xFF;
+    uint8x16x4_t tables[4][4];
+    for (int b = 0; b < 4; b++)
+        for (int t = 0; t < 4; t++)
+            tables[b][t] = vld1q_u8_x4(&planes[b][64 * t]);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t index[4];
+        index[0] = vld1q_u8(src + i);
+        for (int t = 1; t < 4; t++)
+            index[t] = vsubq_u8(index[0], vdupq_n_u8(64 * t));
+        uint8x16x4_t argb;
+        for (int b = 0; b < 4; b++) {
+            uint8x16_t v = vqtbl4q_u8(tables[b][0], index[0]);
+            for (int t = 1; t < 4; t++)
+                v = vorrq_u8(v, vqtbl4q_u8(tables[b][t], index[t]));
+            argb.val[b] = v;
+        }
+        vst4q_u8((uint8_t *)(dst + i), argb);
+    }
+    ExpandIndexRowScalar(src + i, dst + i, count - i, palette);
+}
+#endif
+
+typedef void (*tExpandIndexRow)(const tIndex *src, tColor *dst, int count, const tColor *palette);
+
+static tExpandIndexRow GetExpandIndexRow(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2"))
+        return ExpandIndexRowAvx2;
+    if (__builtin_cpu_supports("ssse3"))
+        return ExpandIndexRowSsse3;
+#elif defined(__aarch64__)
+    return ExpandIndexRowNeon;
+#endif
+    return ExpandIndexRowScalar;
+}
+
+static void ExpandIndexRows(const cBitmap *Bitmap, const tColor *palette, tColor *argb, int firstRow, int lastRow) {
+    static const tExpandIndexRow ExpandIndexRow = GetExpandIndexRow();
+    int width = Bitmap->Width();
+    for (int y = firstRow; y < lastRow; y++)
+        ExpandIndexRow(Bitmap->Data(0, y), argb + y * width, width, palette);
+}
+
+/* palette has to contain MAXNUMCOLORS entries */
+void ConvertBitmapToArgb(const cBitmap &Bitmap, const tColor *palette, tColor *argb) {
+    int height = Bitmap.Height();
+    int threads = 1;
+    if (Bitmap.Width() * height >= BITMAP_MT_THRESHOLD)
+        threads = constrain((int)std::thread::hardware_concurrency(), 1, BITMAP_MAX_THREADS);
+    if (threads == 1) {
+        ExpandIndexRows(&Bitmap, palette, argb, 0, height);
+        return;
+    }
+    std::vector<std::thread> workers;
+    int rows = (height + threads - 1) / threads;
+    for (int i = 1; i < threads; i++)
+        workers.push_back(std::thread(ExpandIndexRows, &Bitmap, palette, argb, std::min(i * rows, height), std::min((i + 1) * rows, height)));
+    ExpandIndexRows(&Bitmap, palette, argb, 0, std::min(rows, height));
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
+
 void glCheckError(const char *stmt, const char *fname, int line) {
     GLint err = glGetError();
     if (err != GL_NO_ERROR)
@@ -77,6 +224,14 @@ void glCheckError(const char *stmt, const char *fname, int line) {
 #define GL_CHECK(stmt) stmt
 #endif
 
+#ifdef USE_GLES2
+#define OGL_IMAGE_FORMAT GL_RGBA
+#define OGL_IMAGE_TYPE GL_UNSIGNED_BYTE
+#else
+#define OGL_IMAGE_FORMAT GL_BGRA
+#define OGL_IMAGE_TYPE GL_UNSIGNED_INT_8_8_8_8_REV
+#endif
+
 #ifdef USE_GLES2
 void eglCheckError(const char *stmt, const char *fname, int line) {
     EGLint err = eglGetError();
@@ -120,6 +275,16 @@ void eglReleaseContext()
 }
 #endif
 
+//FNV-1a, hash may continue a previous one
+static uint64_t HashData(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+    const uchar *p = (const uchar *)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 /****************************************************************************************
 * cShader
 ****************************************************************************************/
@@ -150,35 +315,57 @@ void main() \
 } \
 ";
 
+const char *pixelVertexShader = 
+"#version 100 \n\
+\
+attribute vec2 position; \
+attribute vec4 pixelColor; \
+varying vec4 rectCol; \
+uniform mat4 projection; \
+\
+void main() \
+{ \
+    gl_Position = projection * vec4(position.x, position.y, 0.0, 1.0); \
+    gl_PointSize = 1.0; \
+    rectCol = pixelColor; \
+} \
+";
+
 const char *textureVertexShader = 
 "#version 100 \n\
 \
 attribute vec2 position; \
 attribute vec2 texCoords; \
 \
-varying vec2 TexCoords; \
-varying vec4 alphaValue;\
+varying vec2 TexCoords; \n\
+#ifdef OGL_ALPHA \n\
+varying vec4 alphaValue; \
+uniform vec4 alpha; \n\
+#endif \n\
 \
-uniform vec4 bColor; \
 uniform mat4 projection; \
-uniform vec4 alpha; \
 \
 void main() \
 { \
     gl_Position = projection * vec4(position.x, position.y, 0.0, 1.0); \
-    TexCoords = texCoords; \
-    alphaValue = alpha; \
+    TexCoords = texCoords; \n\
+#ifdef OGL_ALPHA \n\
+    alphaValue = alpha; \n\
+#endif \n\
 } \
 ";
 
 const char *textureFragmentShader = 
 "#version 100 \n\
 precision mediump float; \
-varying vec2 TexCoords; \
-varying vec4 alphaValue; \
+varying vec2 TexCoords; \n\
+#ifdef OGL_ALPHA \n\
+varying vec4 alphaValue; \n\
+#endif \n\
 \
+uniform sampler2D screenTexture; \n\
+#ifdef OGL_BORDER \n\
 uniform vec4 bColor; \
-uniform sampler2D screenTexture; \
 \
 float clamp_to_border_factor (vec2 coords) \
 { \
@@ -186,13 +373,19 @@ float clamp_to_border_factor (vec2 coords) \
     bvec2 out2 = lessThan (coords, vec2 (0,0)); \
     bool do_clamp = (any (out1) || any (out2)); \
     return float (!do_clamp); \
-} \
+} \n\
+#endif \n\
 \
 void main() \
 { \
-    vec4 color = texture2D(screenTexture, TexCoords) * alphaValue; \
-    float f = clamp_to_border_factor (TexCoords); \
-    gl_FragColor = mix (bColor, color, f); \
+    vec4 color = texture2D(screenTexture, TexCoords); \n\
+#ifdef OGL_ALPHA \n\
+    color *= alphaValue; \n\
+#endif \n\
+#ifdef OGL_BORDER \n\
+    color = mix (bColor, color, clamp_to_border_factor (TexCoords)); \n\
+#endif \n\
+    gl_FragColor = color; \
 } \
 ";
 
@@ -231,6 +424,47 @@ void main() \
 } \
 ";
 
+const char *paletteFragmentShader = 
+"#version 100 \n\
+precision mediump float; \
+varying vec2 TexCoords; \
+\
+uniform sampler2D indexTexture; \
+uniform sampler2D paletteTexture; \
+uniform float overlay; \
+uniform float bilinear; \
+uniform vec2 indexSize; \
+\
+vec4 lookup(vec2 coords) \
+{ \
+    float index = floor(texture2D(indexTexture, coords).r * 255.0 + 0.5); \
+    vec4 color = texture2D(paletteTexture, vec2((index + 0.5) / 256.0, 0.5)); \
+    if (overlay > 0.5 && index < 0.5) \
+        color = vec4(0.0); \
+    return vec4(color.rgb * color.a, color.a); \
+} \
+\
+void main() \
+{ \
+    if (bilinear < 0.5) { \
+        float index = floor(texture2D(indexTexture, TexCoords).r * 255.0 + 0.5); \
+        if (overlay > 0.5 && index < 0.5) \
+            discard; \
+        gl_FragColor = texture2D(paletteTexture, vec2((index + 0.5) / 256.0, 0.5)); \
+        return; \
+    } \
+    vec2 pos = TexCoords * indexSize - 0.5; \
+    vec2 f = fract(pos); \
+    vec2 texel = 1.0 / indexSize; \
+    vec2 base = (floor(pos) + 0.5) * texel; \
+    vec4 color = mix(mix(lookup(base), lookup(base + vec2(texel.x, 0.0)), f.x), \
+                     mix(lookup(base + vec2(0.0, texel.y)), lookup(base + texel), f.x), f.y); \
+    if (overlay > 0.5 && color.a < 0.004) \
+        discard; \
+    gl_FragColor = color.a > 0.0 ? vec4(color.rgb / color.a, color.a) : vec4(0.0); \
+} \
+";
+
 #else /* OpenGL shader */
 
 const char *rectVertexShader = 
@@ -260,37 +494,61 @@ void main() \
 } \
 ";
 
+const char *pixelVertexShader = 
+"#version 330 core \n\
+\
+layout (location = 0) in vec2 position; \
+layout (location = 1) in vec4 pixelColor; \
+out vec4 rectCol; \
+uniform mat4 projection; \
+\
+void main() \
+{ \
+    gl_Position = projection * vec4(position.x, position.y, 0.0, 1.0); \
+    rectCol = pixelColor; \
+} \
+";
+
 const char *textureVertexShader = 
 "#version 330 core \n\
 \
 layout (location = 0) in vec2 position; \
 layout (location = 1) in vec2 texCoords; \
 \
-out vec2 TexCoords; \
-out vec4 alphaValue;\
+out vec2 TexCoords; \n\
+#ifdef OGL_ALPHA \n\
+out vec4 alphaValue; \
+uniform vec4 alpha; \n\
+#endif \n\
 \
 uniform mat4 projection; \
-uniform vec4 alpha; \
 \
 void main() \
 { \
     gl_Position = projection * vec4(position.x, position.y, 0.0, 1.0); \
-    TexCoords = texCoords; \
-    alphaValue = alpha; \
+    TexCoords = texCoords; \n\
+#ifdef OGL_ALPHA \n\
+    alphaValue = alpha; \n\
+#endif \n\
 } \
 ";
 
 const char *textureFragmentShader = 
 "#version 330 core \n\
-in vec2 TexCoords; \
-in vec4 alphaValue; \
+in vec2 TexCoords; \n\
+#ifdef OGL_ALPHA \n\
+in vec4 alphaValue; \n\
+#endif \n\
 out vec4 color; \
 \
 uniform sampler2D screenTexture; \
 \
 void main() \
 { \
-    color = texture(screenTexture, TexCoords) * alphaValue; \
+    color = texture(screenTexture, TexCoords); \n\
+#ifdef OGL_ALPHA \n\
+    color *= alphaValue; \n\
+#endif \n\
 } \
 ";
 
@@ -329,16 +587,66 @@ void main() \
     color = textColor * sampled; \
 } \
 ";
+const char *paletteFragmentShader = 
+"#version 330 core \n\
+in vec2 TexCoords; \
+out vec4 color; \
+\
+uniform sampler2D indexTexture; \
+uniform sampler2D paletteTexture; \
+uniform float overlay; \
+uniform float bilinear; \
+uniform vec2 indexSize; \
+\
+vec4 lookup(vec2 coords) \
+{ \
+    float index = floor(texture(indexTexture, coords).r * 255.0 + 0.5); \
+    vec4 entry = texture(paletteTexture, vec2((index + 0.5) / 256.0, 0.5)); \
+    if (overlay > 0.5 && index < 0.5) \
+        entry = vec4(0.0); \
+    return vec4(entry.rgb * entry.a, entry.a); \
+} \
+\
+void main() \
+{ \
+    if (bilinear < 0.5) { \
+        float index = floor(texture(indexTexture, TexCoords).r * 255.0 + 0.5); \
+        if (overlay > 0.5 && index < 0.5) \
+            discard; \
+        color = texture(paletteTexture, vec2((index + 0.5) / 256.0, 0.5)); \
+        return; \
+    } \
+    vec2 pos = TexCoords * indexSize - 0.5; \
+    vec2 f = fract(pos); \
+    vec2 texel = 1.0 / indexSize; \
+    vec2 base = (floor(pos) + 0.5) * texel; \
+    vec4 filtered = mix(mix(lookup(base), lookup(base + vec2(texel.x, 0.0)), f.x), \
+                     mix(lookup(base + vec2(0.0, texel.y)), lookup(base + texel), f.x), f.y); \
+    if (overlay > 0.5 && filtered.a < 0.004) \
+        discard; \
+    color = filtered.a > 0.0 ? vec4(filtered.rgb / filtered.a, filtered.a) : vec4(0.0); \
+} \
+";
 #endif
 
-static cShader *Shaders[stCount]; 
+static cShader *Shaders[stCount][svCount];
+static cOglProgramCache *ProgramCache = NULL;
+
+//variants each shader type is specialized for, this one is its generic shader
+#ifdef USE_GLES2
+static const int ShaderVariants[stCount] = { 0, svAlpha | svBorder, 0, 0, 0 };
+#else
+static const int ShaderVariants[stCount] = { 0, svAlpha, 0, 0, 0 };
+#endif
 
 void cShader::Use(void) {
     GL_CHECK(glUseProgram(id));
+    uses++;
 }
 
-bool cShader::Load(eShaderType type) {
+bool cShader::Load(eShaderType type, int variant) {
     this->type = type;
+    this->variant = variant;
 
     const char *vertexCode = NULL;
     const char *fragmentCode = NULL;
@@ -356,6 +664,14 @@ bool cShader::Load(eShaderType type) {
             vertexCode = textVertexShader;
             fragmentCode = textFragmentShader;
             break;
+        case stPixel:
+            vertexCode = pixelVertexShader;
+            fragmentCode = rectFragmentShader;
+            break;
+        case stPalette:
+            vertexCode = textureVertexShader;
+            fragmentCode = paletteFragmentShader;
+            break;
         default:
             esyslog("[openglosd]unknown shader type\n");
             break;
@@ -397,17 +713,37 @@ void cShader::SetMatrix4(const GLchar *name, const glm::mat4 &matrix) {
     GL_CHECK(glUniformMatrix4fv(glGetUniformLocation(id, name), 1, GL_FALSE, glm::value_ptr(matrix)));
 }
 
+//the #defines of the variant have to follow the #version line
+static void ShaderSource(GLuint shader, const char *code, const char *defines) {
+    const char *body = strchr(code, '\n');
+    body = body ? body + 1 : code;
+    const GLchar *sources[] = { code, defines, body };
+    GLint lengths[] = { (GLint)(body - code), -1, -1 };
+    GL_CHECK(glShaderSource(shader, 3, sources, lengths));
+}
+
 bool cShader::Compile(const char *vertexCode, const char *fragmentCode) {
+    cString defines = cString::sprintf("%s%s",
+                                       (variant & svAlpha) ? "#define OGL_ALPHA\n" : "",
+                                       (variant & svBorder) ? "#define OGL_BORDER\n" : "");
+    uint64_t hash = 0;
+    if (ProgramCache) {
+        hash = ProgramCache->Hash(vertexCode, fragmentCode, defines);
+        GL_CHECK(id = glCreateProgram());
+        if (ProgramCache->Load(id, type, variant, hash))
+            return true;
+        GL_CHECK(glDeleteProgram(id));
+    }
     GLuint sVertex, sFragment;
     // Vertex Shader
     GL_CHECK(sVertex = glCreateShader(GL_VERTEX_SHADER));
-    GL_CHECK(glShaderSource(sVertex, 1, &vertexCode, NULL));
+    ShaderSource(sVertex, vertexCode, defines);
     GL_CHECK(glCompileShader(sVertex));
     if (!CheckCompileErrors(sVertex))
         return false;
     // Fragment Shader
     GL_CHECK(sFragment = glCreateShader(GL_FRAGMENT_SHADER));
-    GL_CHECK(glShaderSource(sFragment, 1, &fragmentCode, NULL));
+    ShaderSource(sFragment, fragmentCode, defines);
     GL_CHECK(glCompileShader(sFragment));
     if (!CheckCompileErrors(sFragment))
         return false;
@@ -418,13 +754,18 @@ bool cShader::Compile(const char *vertexCode, const char *fragmentCode) {
 #ifdef USE_GLES2
     GL_CHECK(glBindAttribLocation(id, 0, "position"));
     GL_CHECK(glBindAttribLocation(id, 1, "texCoords"));
+    GL_CHECK(glBindAttribLocation(id, 1, "pixelColor"));
 #endif
+    if (ProgramCache)
+        ProgramCache->PrepareLink(id);
     GL_CHECK(glLinkProgram(id));
     if (!CheckCompileErrors(id, true))
         return false;
     // Delete the shaders as they're linked into our program now and no longer necessery
     GL_CHECK(glDeleteShader(sVertex));
     GL_CHECK(glDeleteShader(sFragment));
+    if (ProgramCache)
+        ProgramCache->Store(id, type, variant, hash);
     return true;
 }
 
@@ -435,55 +776,468 @@ bool cShader::CheckCompileErrors(GLuint object, bool program) {
         GL_CHECK(glGetShaderiv(object, GL_COMPILE_STATUS, &success));
         if (!success) {
             GL_CHECK(glGetShaderInfoLog(object, 1024, NULL, infoLog));
-            esyslog("[openglosd]:SHADER: Compile-time error: Type: %d - %s", type, infoLog);
+            esyslog("[openglosd]:SHADER: Compile-time error: Type: %d Variant: %d - %s", type, variant, infoLog);
             return false;
         }
     } else {
         GL_CHECK(glGetProgramiv(object, GL_LINK_STATUS, &success));
         if (!success) {
             GL_CHECK(glGetProgramInfoLog(object, 1024, NULL, infoLog));
-            esyslog("[openglosd]:SHADER: Link-time error: Type: %d", type);
+            esyslog("[openglosd]:SHADER: Link-time error: Type: %d Variant: %d", type, variant);
+            return false;
+        }
+    }
+    return true;
+}
+
+/****************************************************************************************
+* cOglProgramCache
+****************************************************************************************/
+#ifdef USE_GLES2
+static PFNGLGETPROGRAMBINARYOESPROC glGetProgramBinaryOESProc;
+static PFNGLPROGRAMBINARYOESPROC glProgramBinaryOESProc;
+#define GL_PROGRAM_BINARY_LENGTH GL_PROGRAM_BINARY_LENGTH_OES
+#define GL_NUM_PROGRAM_BINARY_FORMATS GL_NUM_PROGRAM_BINARY_FORMATS_OES
+#endif
+
+//needs the current context of the worker thread
+cOglProgramCache::cOglProgramCache(void) {
+    supported = false;
+    driverHash = 0;
+    loaded = 0;
+    stored = 0;
+    const char *cacheDir = cPlugin::CacheDirectory("oglosd");
+    if (!cacheDir)
+        return;
+    dir = cacheDir;
+    GLint formats = 0;
+#ifdef USE_GLES2
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+    if (extensions && strstr(extensions, "GL_OES_get_program_binary")) {
+        glGetProgramBinaryOESProc = (PFNGLGETPROGRAMBINARYOESPROC)eglGetProcAddress("glGetProgramBinaryOES");
+        glProgramBinaryOESProc = (PFNGLPROGRAMBINARYOESPROC)eglGetProcAddress("glProgramBinaryOES");
+        if (glGetProgramBinaryOESProc && glProgramBinaryOESProc)
+            GL_CHECK(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats));
+    }
+#else
+    if (GLEW_ARB_get_program_binary)
+        GL_CHECK(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats));
+#endif
+    supported = formats > 0;
+    if (!supported) {
+        dsyslog("[openglosd]program binaries not supported, shaders are compiled from source");
+        return;
+    }
+    //binaries are only valid for the driver that created them
+    const GLubyte *driver[] = { glGetString(GL_VENDOR), glGetString(GL_RENDERER), glGetString(GL_VERSION) };
+    driverHash = HashData("", 0);
+    for (int i = 0; i < 3; i++) {
+        if (driver[i])
+            driverHash = HashData(driver[i], strlen((const char *)driver[i]) + 1, driverHash);
+    }
+}
+
+cOglProgramCache::~cOglProgramCache(void) {
+    if (supported)
+        dsyslog("[openglosd]program cache: %d programs loaded, %d stored", loaded, stored);
+}
+
+cString cOglProgramCache::FileName(int type, int variant) {
+    return cString::sprintf("%s/program-%d-%d.bin", *dir, type, variant);
+}
+
+uint64_t cOglProgramCache::Hash(const char *vertexCode, const char *fragmentCode, const char *defines) {
+    uint64_t hash = HashData(vertexCode, strlen(vertexCode) + 1, driverHash);
+    hash = HashData(fragmentCode, strlen(fragmentCode) + 1, hash);
+    return HashData(defines, strlen(defines) + 1, hash);
+}
+
+void cOglProgramCache::PrepareLink(GLuint program) {
+#ifndef USE_GLES2
+    if (supported)
+        GL_CHECK(glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+#endif
+}
+
+//false if the program has to be compiled from source
+bool cOglProgramCache::Load(GLuint program, int type, int variant, uint64_t hash) {
+    if (!supported)
+        return false;
+    cString fileName = FileName(type, variant);
+    int fd = open(*fileName, O_RDONLY);
+    if (fd < 0)
+        return false;
+    std::vector<char> data;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > (off_t)sizeof(sOglProgramCacheHeader)) {
+        data.resize(st.st_size);
+        if (read(fd, &data[0], st.st_size) != st.st_size)
+            data.clear();
+    }
+    close(fd);
+    if (data.empty())
+        return false;
+    //an outdated file is overwritten by Store()
+    const sOglProgramCacheHeader *header = (const sOglProgramCacheHeader *)&data[0];
+    if (memcmp(header->magic, "OGLP", 4) || header->version != OGL_PROGRAMCACHE_VERSION ||
+        header->hash != hash || header->length != data.size() - sizeof(sOglProgramCacheHeader))
+        return false;
+#ifdef USE_GLES2
+    GL_CHECK(glProgramBinaryOESProc(program, header->format, &data[sizeof(sOglProgramCacheHeader)], header->length));
+#else
+    GL_CHECK(glProgramBinary(program, header->format, &data[sizeof(sOglProgramCacheHeader)], header->length));
+#endif
+    GLint success = GL_FALSE;
+    GL_CHECK(glGetProgramiv(program, GL_LINK_STATUS, &success));
+    if (!success) {
+        //e.g. after a driver update that kept its version string
+        dsyslog("[openglosd]program binary %s rejected by the driver", *fileName);
+        while (glGetError() != GL_NO_ERROR)
+            ;
+        return false;
+    }
+    loaded++;
+    return true;
+}
+
+void cOglProgramCache::Store(GLuint program, int type, int variant, uint64_t hash) {
+    if (!supported)
+        return;
+    GLint length = 0;
+    GL_CHECK(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length));
+    if (length <= 0)
+        return;
+    std::vector<char> binary(length);
+    GLsizei written = 0;
+    GLenum format = 0;
+#ifdef USE_GLES2
+    GL_CHECK(glGetProgramBinaryOESProc(program, length, &written, &format, &binary[0]));
+#else
+    GL_CHECK(glGetProgramBinary(program, length, &written, &format, &binary[0]));
+#endif
+    if (written <= 0)
+        return;
+    cString fileName = FileName(type, variant);
+    cString tmpName = cString::sprintf("%s.tmp", *fileName);
+    FILE *f = fopen(*tmpName, "wb");
+    if (!f) {
+        esyslog("[openglosd]cannot write program cache %s", *tmpName);
+        return;
+    }
+    sOglProgramCacheHeader header;
+    memcpy(header.magic, "OGLP", 4);
+    header.version = OGL_PROGRAMCACHE_VERSION;
+    header.format = format;
+    header.length = written;
+    header.hash = hash;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(&binary[0], 1, written, f) == (size_t)written;
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(*tmpName, *fileName) != 0) {
+        esyslog("[openglosd]cannot write program cache %s", *fileName);
+        unlink(*tmpName);
+        return;
+    }
+    stored++;
+}
+
+/****************************************************************************************
+* cOglUploader
+****************************************************************************************/
+static cOglUploader *Uploader = NULL;
+
+cOglUploader::cOglUploader(void) {
+    chunkSize = OGL_UPLOAD_MIN_CHUNK;
+}
+
+cOglUploader::~cOglUploader(void) {
+    dsyslog("[openglosd]texture upload chunk size: %ldkb", chunkSize / 1024);
+}
+
+int cOglUploader::ChunkRows(int rowBytes) {
+    return std::max(1L, chunkSize / rowBytes);
+}
+
+void cOglUploader::Adapt(long size, int elapsed) {
+    //only chunks which used most of the chunk size tell something about the throughput
+    if (size < chunkSize / 2)
+        return;
+    if (elapsed > OGL_UPLOAD_TIMESLICE)
+        chunkSize = std::max(chunkSize / 2, (long)OGL_UPLOAD_MIN_CHUNK);
+    else if (elapsed < OGL_UPLOAD_TIMESLICE / 2)
+        chunkSize = std::min(chunkSize * 2, (long)OGL_UPLOAD_MAX_CHUNK);
+}
+
+//uploads rows to the currently bound texture
+void cOglUploader::Upload(GLint width, GLint y, GLint rows, GLenum format, GLenum type, const void *data, int rowBytes) {
+    if (rows <= 0)
+        return;
+    long size = (long)rows * rowBytes;
+    uint64_t start = cTimeMs::Now();
+    //the driver has copied the rows when this returns, so the time bounds the chunk
+    GL_CHECK(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, width, rows, format, type, data));
+    Adapt(size, cTimeMs::Now() - start);
+}
+
+/****************************************************************************************
+* cOglGlyphCache
+****************************************************************************************/
+cOglGlyphCache::cOglGlyphCache(uint64_t fontHash, int size) {
+    this->size = size;
+    map = NULL;
+    mapSize = 0;
+    entries = NULL;
+    count = 0;
+    generation = 0;
+    this->fontHash = fontHash;
+    const char *dir = cPlugin::CacheDirectory("oglosd");
+    if (!dir || !fontHash)
+        return;
+    fileName = cString::sprintf("%s/glyphs-%016llx-%d.bin", dir, (unsigned long long)fontHash, size);
+    uint64_t start = cTimeMs::Now();
+    if (Load())
+        dsyslog("[openglosd]loaded %d glyphs from %s in %dms", count, *fileName, (int)(cTimeMs::Now() - start));
+}
+
+cOglGlyphCache::~cOglGlyphCache(void) {
+    Unmap();
+}
+
+bool cOglGlyphCache::Load(void) {
+    int fd = open(*fileName, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(sOglGlyphCacheHeader)) {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            map = (GLubyte *)data;
+            mapSize = st.st_size;
+        }
+    }
+    close(fd);
+    if (!map)
+        return false;
+    //anything not matching is rebuilt and overwritten by the next Save()
+    const sOglGlyphCacheHeader *header = (const sOglGlyphCacheHeader *)map;
+    if (memcmp(header->magic, "OGLG", 4) || header->version != OGL_GLYPHCACHE_VERSION ||
+        header->ftVersion != FREETYPE_MAJOR * 10000 + FREETYPE_MINOR * 100 + FREETYPE_PATCH ||
+        header->size != (uint32_t)size || header->stroke != OGL_GLYPH_STROKE || header->fontHash != fontHash ||
+        header->count > (mapSize - sizeof(sOglGlyphCacheHeader)) / sizeof(sOglGlyphCacheEntry)) {
+        dsyslog("[openglosd]glyph cache %s is outdated", *fileName);
+        Unmap();
+        return false;
+    }
+    entries = (const sOglGlyphCacheEntry *)(map + sizeof(sOglGlyphCacheHeader));
+    for (uint32_t i = 0; i < header->count; i++) {
+        const sOglGlyphCacheEntry &e = entries[i];
+        if (e.width < 0 || e.height < 0 || e.offset > mapSize || (size_t)e.width * e.height > mapSize - e.offset) {
+            esyslog("[openglosd]glyph cache %s is corrupt", *fileName);
+            Unmap();
             return false;
         }
     }
+    count = header->count;
+    generation = header->generation;
+    index.reserve(count);
+    lastUsed.resize(count);
+    for (int i = 0; i < count; i++) {
+        index[entries[i].charCode] = i;
+        lastUsed[i] = entries[i].lastUsed;
+    }
     return true;
 }
 
-#define KERNING_UNKNOWN  (-10000)
+void cOglGlyphCache::Unmap(void) {
+    if (map)
+        munmap(map, mapSize);
+    map = NULL;
+    mapSize = 0;
+    entries = NULL;
+    count = 0;
+    index.clear();
+    lastUsed.clear();
+}
+
+const sOglGlyphCacheEntry *cOglGlyphCache::Find(uint charCode) {
+    std::unordered_map<uint, int>::const_iterator it = index.find(charCode);
+    return it == index.end() ? NULL : &entries[it->second];
+}
+
+//keeps the glyph in the file for the next OGL_GLYPHCACHE_MAX_AGE saves
+void cOglGlyphCache::Use(const sOglGlyphCacheEntry *entry) {
+    lastUsed[entry - entries] = generation + 1;
+}
+
+void cOglGlyphCache::Add(const sOglGlyphCacheEntry &entry, const GLubyte *bitmap, int pitch) {
+    if (!*fileName)
+        return;
+    sOglGlyphCacheEntry e = entry;
+    e.offset = addedBitmaps.size();     //relative to the added bitmaps until saved
+    e.lastUsed = generation + 1;
+    added.push_back(e);
+    for (int y = 0; y < entry.height; y++)
+        addedBitmaps.insert(addedBitmaps.end(), bitmap + y * pitch, bitmap + y * pitch + entry.width);
+}
+
+//writes the added glyphs and the loaded ones drawn lately to a new file, which replaces the old one
+void cOglGlyphCache::Save(void) {
+    if (!*fileName || added.empty())
+        return;
+    cString tmpName = cString::sprintf("%s.tmp", *fileName);
+    FILE *f = fopen(*tmpName, "wb");
+    if (!f) {
+        esyslog("[openglosd]cannot write glyph cache %s", *tmpName);
+        return;
+    }
+    sOglGlyphCacheHeader header;
+    memcpy(header.magic, "OGLG", 4);
+    header.version = OGL_GLYPHCACHE_VERSION;
+    header.ftVersion = FREETYPE_MAJOR * 10000 + FREETYPE_MINOR * 100 + FREETYPE_PATCH;
+    header.size = size;
+    header.stroke = OGL_GLYPH_STROKE;
+    header.generation = generation + 1;
+    header.fontHash = fontHash;
+    std::vector<int> kept;
+    for (int i = 0; i < count; i++) {
+        if (header.generation - lastUsed[i] < OGL_GLYPHCACHE_MAX_AGE)
+            kept.push_back(i);
+    }
+    header.count = kept.size() + added.size();
+    uint32_t offset = sizeof(header) + header.count * sizeof(sOglGlyphCacheEntry);
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (size_t i = 0; ok && i < kept.size(); i++) {
+        sOglGlyphCacheEntry e = entries[kept[i]];
+        e.offset = offset;
+        e.lastUsed = lastUsed[kept[i]];
+        offset += e.width * e.height;
+        ok = fwrite(&e, sizeof(e), 1, f) == 1;
+    }
+    for (size_t i = 0; ok && i < added.size(); i++) {
+        sOglGlyphCacheEntry e = added[i];
+        e.offset = offset;
+        offset += e.width * e.height;
+        ok = fwrite(&e, sizeof(e), 1, f) == 1;
+    }
+    for (size_t i = 0; ok && i < kept.size(); i++) {
+        const sOglGlyphCacheEntry &e = entries[kept[i]];
+        size_t len = e.width * e.height;
+        ok = fwrite(map + e.offset, 1, len, f) == len;
+    }
+    if (ok && !addedBitmaps.empty())
+        ok = fwrite(&addedBitmaps[0], 1, addedBitmaps.size(), f) == addedBitmaps.size();
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(*tmpName, *fileName) != 0) {
+        esyslog("[openglosd]cannot write glyph cache %s", *fileName);
+        unlink(*tmpName);
+        return;
+    }
+    dsyslog("[openglosd]saved %d glyphs to %s, %d unused ones dropped", header.count, *fileName, count - (int)kept.size());
+    //continue with the new file, so later additions keep the saved glyphs
+    added.clear();
+    addedBitmaps.clear();
+    Unmap();
+    Load();
+}
+
 /****************************************************************************************
 * cOglGlyph
 ****************************************************************************************/
-cOglGlyph::cOglGlyph(uint charCode, FT_BitmapGlyph ftGlyph) {
+std::list<cOglGlyph*> cOglGlyph::resident;
+cMutex cOglGlyph::statsMutex;
+sOglGlyphStats cOglGlyph::stats = { 0, 0, OGL_GLYPH_MAX_MEMORY * 1024 * 1024, 0, 0, 0, 0 };
+
+cOglGlyph::cOglGlyph(const cOglFont *font, uint charCode, FT_UInt glyphIndex, FT_BitmapGlyph ftGlyph) {
+    this->font = font;
+    texture = 0;
     this->charCode = charCode;
+    this->glyphIndex = glyphIndex;
     bearingLeft = ftGlyph->left;
     bearingTop = ftGlyph->top;
     width = ftGlyph->bitmap.width;
     height = ftGlyph->bitmap.rows;
     advanceX = ftGlyph->root.advance.x >> 16;   //value in 1/2^16 pixel
-    LoadTexture(ftGlyph);
+    LoadTexture(ftGlyph->bitmap.buffer);
+}
+
+cOglGlyph::cOglGlyph(const cOglFont *font, const sOglGlyphCacheEntry *entry, const GLubyte *bitmap) {
+    this->font = font;
+    texture = 0;
+    charCode = entry->charCode;
+    glyphIndex = entry->glyphIndex;
+    bearingLeft = entry->bearingLeft;
+    bearingTop = entry->bearingTop;
+    width = entry->width;
+    height = entry->height;
+    advanceX = entry->advanceX;
+    LoadTexture(bitmap);
 }
 
 cOglGlyph::~cOglGlyph(void) {
+    Evict();
+}
+
+void cOglGlyph::SetMemoryBudget(long bytes) {
+    cMutexLock lock(&statsMutex);
+    stats.memBudget = bytes;
+}
+
+sOglGlyphStats cOglGlyph::Stats(void) {
+    cMutexLock lock(&statsMutex);
+    return stats;
+}
 
+void cOglGlyph::LogStats(void) {
+    sOglGlyphStats s = Stats();
+    dsyslog("[openglosd]glyph memory: %.2fMB of %.2fMB used, peak %.2fMB, %d resident, %d uploads, %d evictions, %d reloads",
+            s.memUsed / 1024.0f / 1024.0f, s.memBudget / 1024.0f / 1024.0f, s.memPeak / 1024.0f / 1024.0f,
+            s.resident, s.uploads, s.evictions, s.reloads);
 }
 
-int cOglGlyph::GetKerningCache(uint prevSym) {
-    for (int i = kerningCache.Size(); --i > 0; ) {
-        if (kerningCache[i].prevSym == prevSym)
-            return kerningCache[i].kerning;
+//evicts least recently drawn glyphs of all fonts until size fits into the budget
+void cOglGlyph::Reserve(long size) {
+    while (!resident.empty() && stats.memUsed + size > stats.memBudget) {
+        resident.back()->Evict();
+        cMutexLock lock(&statsMutex);
+        stats.evictions++;
     }
-    return KERNING_UNKNOWN;
 }
 
-void cOglGlyph::SetKerningCache(uint prevSym, int kerning) {
-    kerningCache.Append(tKerning(prevSym, kerning));
+void cOglGlyph::Evict(void) {
+    if (!texture)
+        return;
+    GL_CHECK(glDeleteTextures(1, &texture));
+    texture = 0;
+    resident.erase(lruPos);
+    cMutexLock lock(&statsMutex);
+    stats.memUsed -= Size();
+    stats.resident--;
 }
 
 void cOglGlyph::BindTexture(void) {
+    if (!texture) {
+        font->Reload(this);
+        cMutexLock lock(&statsMutex);
+        stats.reloads++;
+    } else if (lruPos != resident.begin())
+        resident.splice(resident.begin(), resident, lruPos);
     GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
 }
 
-void cOglGlyph::LoadTexture(FT_BitmapGlyph ftGlyph) {
+void cOglGlyph::LoadTexture(const GLubyte *buffer) {
+    if (texture)
+        return;
+    Reserve(Size());
+    resident.push_front(this);
+    lruPos = resident.begin();
+    {
+        cMutexLock lock(&statsMutex);
+        stats.memUsed += Size();
+        stats.memPeak = std::max(stats.memPeak, stats.memUsed);
+        stats.resident++;
+        stats.uploads++;
+    }
     // Disable byte-alignment restriction
     GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
     GL_CHECK(glGenTextures(1, &texture));
@@ -497,8 +1251,8 @@ void cOglGlyph::LoadTexture(FT_BitmapGlyph ftGlyph) {
 #else
         GL_RED,
 #endif
-        ftGlyph->bitmap.width,
-        ftGlyph->bitmap.rows,
+        width,
+        height,
         0,
 #ifdef USE_GLES2
         GL_LUMINANCE,
@@ -506,8 +1260,15 @@ void cOglGlyph::LoadTexture(FT_BitmapGlyph ftGlyph) {
         GL_RED,
 #endif
         GL_UNSIGNED_BYTE,
-        ftGlyph->bitmap.buffer
+        NULL
     ));
+    Uploader->Upload(width, 0, height,
+#ifdef USE_GLES2
+                     GL_LUMINANCE,
+#else
+                     GL_RED,
+#endif
+                     GL_UNSIGNED_BYTE, buffer, width);
 
     // Set texture options
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
@@ -520,58 +1281,461 @@ void cOglGlyph::LoadTexture(FT_BitmapGlyph ftGlyph) {
 
 
 /****************************************************************************************
-* cOglFont
+* cOglFontMetrics
 ****************************************************************************************/
-FT_Library cOglFont::ftLib = 0;
-cList<cOglFont> *cOglFont::fonts = 0;
-bool cOglFont::initiated = false;
-
-cOglFont::cOglFont(const char *fontName, int charHeight) : name(fontName) {
-    size = charHeight;
-    height = 0;
-    bottom = 0;
-
-    int error = FT_New_Face(ftLib, fontName, 0, &face);
-    if (error)
-        esyslog("[openglosd]ERROR: failed to open %s!", *name);
-
-    FT_Set_Char_Size(face, 0, charHeight * 64, 0, 0);
-    height = (face->size->metrics.ascender - face->size->metrics.descender + 63) / 64;
-    bottom = abs((face->size->metrics.descender - 63) / 64);
+cOglFontMetrics::cOglFontMetrics(const char *fontFile, int size) : fontFile(fontFile) {
+    this->size = size;
+    shared = NULL;
+    ftSize = NULL;
+    opened = false;
+    hasKerning = false;
+}
+
+cOglFontMetrics::~cOglFontMetrics(void) {
+    //the size is freed with its face by cOglFaceLoader
+}
+
+//the face is only needed for metrics the worker thread did not provide yet
+bool cOglFontMetrics::Open(void) {
+    if (opened)
+        return ftSize != NULL;
+    opened = true;
+    cOglFaceLoader *loader = cOglFaceLoader::Instance();
+    shared = loader->MetricsFace(*fontFile);
+    if (!shared) {
+        esyslog("[openglosd]ERROR: failed to open %s for metrics!", *fontFile);
+        return false;
+    }
+    cMutexLock lock(shared->metricsMutex);
+    ftSize = loader->NewSize(shared->metricsFace);
+    if (!ftSize)
+        return false;
+    FT_Activate_Size(ftSize);
+    FT_Set_Char_Size(shared->metricsFace, 0, size * 64, 0, 0);
+    hasKerning = FT_HAS_KERNING(shared->metricsFace);
+    return true;
 }
 
-cOglFont::~cOglFont(void) {
-    FT_Done_Face(face);
+//by the worker thread, for each glyph it loads
+void cOglFontMetrics::Set(uint charCode, FT_UInt glyphIndex, int advanceX) {
+    cMutexLock lock(&mutex);
+    sOglGlyphMetrics m = { glyphIndex, advanceX };
+    glyphs[charCode] = m;
 }
 
-cOglFont *cOglFont::Get(const char *name, int charHeight) {
-    if (!fonts)
-        Init();
+const sOglGlyphMetrics *cOglFontMetrics::Lookup(uint charCode) {
+    std::unordered_map<uint, sOglGlyphMetrics>::const_iterator it = glyphs.find(charCode);
+    if (it != glyphs.end())
+        return &it->second;
+    if (!Open())
+        return NULL;
+    //same load flags as cOglFont::Glyph(), so the hinted advance matches
+    sOglGlyphMetrics m;
+    FT_Fixed advance;
+    {
+        cMutexLock lock(shared->metricsMutex);
+        FT_Activate_Size(ftSize);
+        m.glyphIndex = FT_Get_Char_Index(shared->metricsFace, charCode);
+        if (FT_Get_Advance(shared->metricsFace, m.glyphIndex, FT_LOAD_NO_BITMAP, &advance))
+            return NULL;
+    }
+    m.advanceX = advance >> 16;   //value in 1/2^16 pixel
+    return &(glyphs[charCode] = m);
+}
 
-    cOglFont *font;
-    for (font = fonts->First(); font; font = fonts->Next(font))
-        if (!strcmp(font->Name(), name) && charHeight == font->Size()) {
-            return font;
+int cOglFontMetrics::Width(const uint *symbols) {
+    cMutexLock lock(&mutex);
+    int width = 0;
+    const sOglGlyphMetrics *prev = NULL;
+    for (int i = 0; symbols[i]; i++) {
+        uint sym = symbols[i];
+        // Non-breaking space:
+        if (sym == 0xA0)
+            sym = 0x20;
+        const sOglGlyphMetrics *m = Lookup(sym);
+        if (!m)
+            continue;
+        if (prev && Open() && hasKerning) {
+            uint64_t key = ((uint64_t)prev->glyphIndex << 32) | m->glyphIndex;
+            std::unordered_map<uint64_t, int>::const_iterator it = kerning.find(key);
+            if (it != kerning.end())
+                width += it->second;
+            else {
+                FT_Vector delta;
+                shared->metricsMutex->Lock();
+                FT_Activate_Size(ftSize);
+                FT_Get_Kerning(shared->metricsFace, prev->glyphIndex, m->glyphIndex, FT_KERNING_DEFAULT, &delta);
+                shared->metricsMutex->Unlock();
+                width += kerning[key] = delta.x / 64;
+            }
         }
-    font = new cOglFont(name, charHeight);
-    fonts->Add(font);
-    return font;
+        width += m->advanceX;
+        prev = m;
+    }
+    return width;
 }
 
-void cOglFont::Init(void) {
-    fonts = new cList<cOglFont>;
+/****************************************************************************************
+* cOglFaceLoader
+****************************************************************************************/
+static cOglFaceLoader *FaceLoader = NULL;      // set while a worker thread runs
+cMutex cOglFaceLoader::instanceMutex;
+cOglFaceLoader *cOglFaceLoader::instance = NULL;
+
+cOglFaceLoader::cOglFaceLoader(void) : cThread("oglFaceLoader") {
+    ftLib = 0;
     if (FT_Init_FreeType(&ftLib))
         esyslog("[openglosd]failed to initialize FreeType library!");
-    initiated = true;
+    Start();
 }
 
-void cOglFont::Cleanup(void) {
-    if (!initiated)
-        return;
-    delete fonts;
-    fonts = 0;
-    if (FT_Done_FreeType(ftLib))
-        esyslog("failed to deinitialize FreeType library!");
+cOglFaceLoader::~cOglFaceLoader(void) {
+    Cancel(-1);
+    wait.Signal();
+    Cancel(3);
+    //the fonts using the faces are gone with cOglFont::Cleanup()
+    size_t mapped = 0;
+    for (std::map<std::string, sOglFace *>::iterator it = faces.begin(); it != faces.end(); ++it) {
+        sOglFace *face = it->second;
+        if (face->stroker)
+            FT_Stroker_Done(face->stroker);
+        if (face->face)
+            FT_Done_Face(face->face);
+        if (face->metricsFace)
+            FT_Done_Face(face->metricsFace);
+        delete face->metricsMutex;
+        if (face->data) {
+            munmap(face->data, face->dataSize);
+            mapped += face->dataSize;
+        }
+        delete face;
+    }
+    dsyslog("[openglosd]font faces: %d files, %.2fMB mapped", (int)faces.size(), mapped / 1024.0f / 1024.0f);
+    if (ftLib && FT_Done_FreeType(ftLib))
+        esyslog("[openglosd]failed to deinitialize FreeType library!");
+}
+
+//the faces outlive the worker thread, because the metrics of the font handles use them
+cOglFaceLoader *cOglFaceLoader::Instance(void) {
+    cMutexLock lock(&instanceMutex);
+    if (!instance)
+        instance = new cOglFaceLoader();
+    return instance;
+}
+
+void cOglFaceLoader::Shutdown(void) {
+    cOglFont::SetFaceLoader(NULL);
+    cMutexLock lock(&instanceMutex);
+    delete instance;
+    instance = NULL;
+}
+
+//starts opening a font file, called by the drawing threads
+void cOglFaceLoader::Request(const char *fileName) {
+    if (!fileName)
+        return;
+    mutex.Lock();
+    bool added = false;
+    if (faces.find(fileName) == faces.end()) {
+        sOglFace *face = new sOglFace;
+        memset(face, 0, sizeof(sOglFace));
+        face->metricsMutex = new cMutex;
+        faces[fileName] = face;
+        jobs.push(fileName);
+        added = true;
+    }
+    mutex.Unlock();
+    if (added)
+        wait.Signal();
+}
+
+//waits only if the face is still being opened
+sOglFace *cOglFaceLoader::Get(const char *fileName) {
+    if (!fileName)
+        return NULL;
+    Request(fileName);
+    cMutexLock lock(&mutex);
+    sOglFace *face = faces[fileName];
+    if (!face->loaded) {
+        uint64_t start = cTimeMs::Now();
+        while (!face->loaded) {
+            if (!loadedVar.TimedWait(mutex, 5000)) {
+                esyslog("[openglosd]ERROR: timeout opening %s", fileName);
+                return NULL;
+            }
+        }
+        dsyslog("[openglosd]waited %dms for %s", (int)(cTimeMs::Now() - start), fileName);
+    }
+    return face->face ? face : NULL;
+}
+
+//a second face on the same mapped file, the worker thread uses the first one without locking
+sOglFace *cOglFaceLoader::MetricsFace(const char *fileName) {
+    sOglFace *face = Get(fileName);
+    if (!face)
+        return NULL;
+    cMutexLock lock(&ftMutex);
+    if (!face->metricsFace && FT_New_Memory_Face(ftLib, (const FT_Byte *)face->data, face->dataSize, 0, &face->metricsFace))
+        face->metricsFace = NULL;
+    return face->metricsFace ? face : NULL;
+}
+
+FT_Size cOglFaceLoader::NewSize(FT_Face face) {
+    cMutexLock lock(&ftMutex);
+    FT_Size size = NULL;
+    if (FT_New_Size(face, &size))
+        return NULL;
+    return size;
+}
+
+void cOglFaceLoader::DoneSize(FT_Size size) {
+    cMutexLock lock(&ftMutex);
+    FT_Done_Size(size);
+}
+
+void cOglFaceLoader::Action(void) {
+    while (Running()) {
+        mutex.Lock();
+        bool empty = jobs.empty();
+        std::string fileName;
+        sOglFace *face = NULL;
+        if (!empty) {
+            fileName = jobs.front();
+            jobs.pop();
+            face = faces[fileName];
+        }
+        mutex.Unlock();
+        if (empty) {
+            wait.Wait(100);
+            continue;
+        }
+        Load(fileName.c_str(), face);
+        mutex.Lock();
+        face->loaded = true;
+        loadedVar.Broadcast();
+        mutex.Unlock();
+    }
+}
+
+void cOglFaceLoader::Load(const char *fileName, sOglFace *face) {
+    uint64_t start = cTimeMs::Now();
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+        esyslog("[openglosd]ERROR: failed to open %s!", fileName);
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            face->data = data;
+            face->dataSize = st.st_size;
+        }
+    }
+    close(fd);
+    if (!face->data) {
+        esyslog("[openglosd]ERROR: failed to map %s!", fileName);
+        return;
+    }
+    //a changed font invalidates its glyph cache
+    face->hash = HashData(face->data, face->dataSize);
+    cMutexLock lock(&ftMutex);
+    if (FT_New_Memory_Face(ftLib, (const FT_Byte *)face->data, face->dataSize, 0, &face->face)) {
+        esyslog("[openglosd]ERROR: failed to open %s!", fileName);
+        face->face = NULL;
+        return;
+    }
+    if (FT_Stroker_New(ftLib, &face->stroker)) {
+        esyslog("[openglosd]ERROR: failed to create stroker for %s!", fileName);
+        FT_Done_Face(face->face);
+        face->face = NULL;
+        face->stroker = NULL;
+        return;
+    }
+    FT_Stroker_Set(face->stroker,
+                   OGL_GLYPH_STROKE,
+                   FT_STROKER_LINECAP_ROUND,
+                   FT_STROKER_LINEJOIN_ROUND,
+                   0);
+    face->openTime = cTimeMs::Now() - start;
+    dsyslog("[openglosd]opened %s (%.1fKB mapped) in %dms", fileName, face->dataSize / 1024.0f, face->openTime);
+}
+
+/****************************************************************************************
+* cOglFont
+****************************************************************************************/
+cMutex cOglFont::handleMutex;
+std::map<std::pair<std::string, int>, int> cOglFont::handleIndex;
+std::deque<sOglFontHandle> cOglFont::handles;
+
+cOglFont::cOglFont(const char *fontName, int charHeight, cOglFontMetrics *metrics) : name(fontName) {
+    this->metrics = metrics;
+    size = charHeight;
+    height = 0;
+    bottom = 0;
+    memset(glyphDirect, 0, sizeof(glyphDirect));
+    glyphCount = 0;
+
+    face = NULL;
+    ftSize = NULL;
+    stroker = NULL;
+    hasKerning = false;
+#ifdef OSD_DEBUG
+    uint64_t start = cTimeMs::Now();
+#endif
+    sOglFace *shared = FaceLoader ? FaceLoader->Get(fontName) : NULL;
+    if (shared) {
+        ftSize = FaceLoader->NewSize(shared->face);
+        if (ftSize) {
+            face = shared->face;
+            stroker = shared->stroker;
+        }
+    }
+    bool error = !face;
+    if (error)
+        esyslog("[openglosd]ERROR: failed to open %s!", *name);
+    else {
+        FT_Activate_Size(ftSize);
+        FT_Set_Char_Size(face, 0, charHeight * 64, 0, 0);
+        hasKerning = FT_HAS_KERNING(face);
+        height = (ftSize->metrics.ascender - ftSize->metrics.descender + 63) / 64;
+        bottom = abs((ftSize->metrics.descender - 63) / 64);
+    }
+#ifdef OSD_DEBUG
+    dsyslog("[openglosd]font %s size %d opened in %dms", *name, size, (int)(cTimeMs::Now() - start));
+#endif
+
+    //glyphs rasterized before get their textures when first drawn, their metrics are known now
+    diskCache = error ? NULL : new cOglGlyphCache(shared->hash, charHeight);
+    if (diskCache) {
+        for (int i = 0; i < diskCache->Count(); i++) {
+            const sOglGlyphCacheEntry *entry = diskCache->Entry(i);
+            metrics->Set(entry->charCode, entry->glyphIndex, entry->advanceX);
+        }
+    }
+}
+
+cOglFont::~cOglFont(void) {
+#ifdef OSD_DEBUG
+    dsyslog("[openglosd]font %s size %d: %d glyphs cached, hash table size %d, %d kerning pairs", *name, size, glyphCount, (int)glyphTable.size(), (int)kerningTable.size());
+#endif
+    for (int i = 0; i < OGL_GLYPH_DIRECT; i++)
+        delete glyphDirect[i];
+    for (std::vector<sOglGlyphSlot>::iterator it = glyphTable.begin(); it != glyphTable.end(); ++it)
+        delete it->glyph;
+    SaveGlyphs();
+    delete diskCache;
+    if (ftSize)
+        FaceLoader->DoneSize(ftSize);
+}
+
+//interns name and size, called by the drawing threads
+int cOglFont::Handle(const char *name, int charHeight) {
+    cMutexLock lock(&handleMutex);
+    std::pair<std::string, int> key(name ? name : "", charHeight);
+    std::map<std::pair<std::string, int>, int>::iterator it = handleIndex.find(key);
+    if (it != handleIndex.end())
+        return it->second;
+    //the entry is complete before the handle is passed to the worker thread
+    sOglFontHandle h;
+    h.name = name;
+    h.size = charHeight;
+    h.metrics = new cOglFontMetrics(name ? name : "", charHeight);
+    h.font = NULL;
+    handles.push_back(h);
+    int handle = handles.size() - 1;
+    handleIndex[key] = handle;
+    //the face is opened while the worker thread is still busy with other commands
+    if (FaceLoader)
+        FaceLoader->Request(name);
+    return handle;
+}
+
+//called by the worker thread only
+cOglFont *cOglFont::Get(int handle) {
+    handleMutex.Lock();
+    sOglFontHandle *h = &handles[handle];
+    handleMutex.Unlock();
+    if (!h->font)
+        h->font = new cOglFont(*h->name, h->size, h->metrics);
+    return h->font;
+}
+
+//called by the drawing threads, gives the advance of the text as cOglCmdDrawText draws it
+int cOglFont::Width(int handle, const uint *symbols) {
+    handleMutex.Lock();
+    cOglFontMetrics *metrics = handles[handle].metrics;
+    handleMutex.Unlock();
+    return metrics->Width(symbols);
+}
+
+//the drawing threads use the loader under handleMutex, so it is only swapped with the mutex held
+cOglFaceLoader *cOglFont::SetFaceLoader(cOglFaceLoader *loader) {
+    cMutexLock lock(&handleMutex);
+    cOglFaceLoader *previous = FaceLoader;
+    FaceLoader = loader;
+    //faces of handles interned before the loader was started
+    if (FaceLoader) {
+        for (std::deque<sOglFontHandle>::iterator it = handles.begin(); it != handles.end(); ++it)
+            FaceLoader->Request(*it->name);
+    }
+    return previous;
+}
+
+void cOglFont::Cleanup(void) {
+    //handles stay valid, their fonts are created again when needed
+    cMutexLock lock(&handleMutex);
+    for (std::deque<sOglFontHandle>::iterator it = handles.begin(); it != handles.end(); ++it) {
+        delete it->font;
+        it->font = NULL;
+    }
+}
+
+static inline uint GlyphHash(uint charCode) {
+    //fibonacci hashing spreads neighbouring code points
+    return charCode * 2654435761u;
+}
+
+cOglGlyph *cOglFont::FindGlyph(uint charCode) const {
+    if (charCode < OGL_GLYPH_DIRECT)
+        return glyphDirect[charCode];
+    if (glyphTable.empty())
+        return NULL;
+    uint mask = glyphTable.size() - 1;
+    for (uint i = GlyphHash(charCode) & mask; ; i = (i + 1) & mask) {
+        const sOglGlyphSlot &slot = glyphTable[i];
+        if (!slot.glyph)
+            return NULL;
+        if (slot.charCode == charCode)
+            return slot.glyph;
+    }
+}
+
+void cOglFont::AddGlyph(cOglGlyph *glyph) const {
+    uint charCode = glyph->CharCode();
+    if (charCode < OGL_GLYPH_DIRECT) {
+        glyphDirect[charCode] = glyph;
+        return;
+    }
+    //keep the load factor below 1/2, so probe sequences stay short
+    if ((glyphCount + 1) * 2 > (int)glyphTable.size()) {
+        std::vector<sOglGlyphSlot> old;
+        old.swap(glyphTable);
+        sOglGlyphSlot empty = { 0, NULL };
+        glyphTable.assign(std::max((size_t)OGL_GLYPH_TABLE_MIN, old.size() * 2), empty);
+        glyphCount = 0;
+        for (std::vector<sOglGlyphSlot>::iterator it = old.begin(); it != old.end(); ++it) {
+            if (it->glyph)
+                AddGlyph(it->glyph);
+        }
+    }
+    uint mask = glyphTable.size() - 1;
+    uint i = GlyphHash(charCode) & mask;
+    while (glyphTable[i].glyph)
+        i = (i + 1) & mask;
+    glyphTable[i].charCode = charCode;
+    glyphTable[i].glyph = glyph;
+    glyphCount++;
 }
 
 cOglGlyph* cOglFont::Glyph(uint charCode) const {
@@ -580,14 +1744,58 @@ cOglGlyph* cOglFont::Glyph(uint charCode) const {
         charCode = 0x20;
 
     // Lookup in cache:
-    for (cOglGlyph *g = glyphCache.First(); g; g = glyphCache.Next(g)) {
-        if (g->CharCode() == charCode) {
-            return g;
-        }
+    cOglGlyph *cached = FindGlyph(charCode);
+    if (cached || !face)
+        return cached;
+
+    //rasterized in an earlier run
+    const sOglGlyphCacheEntry *entry = diskCache ? diskCache->Find(charCode) : NULL;
+    if (entry) {
+        diskCache->Use(entry);
+        cached = new cOglGlyph(this, entry, diskCache->Bitmap(entry));
+        AddGlyph(cached);
+        return cached;
     }
 
     FT_UInt glyph_index = FT_Get_Char_Index(face, charCode);
+    FT_Glyph ftGlyph = Rasterize(glyph_index);
+    if (!ftGlyph)
+        return NULL;
 
+    cOglGlyph *Glyph = new cOglGlyph(this, charCode, glyph_index, (FT_BitmapGlyph)ftGlyph);
+    AddGlyph(Glyph);
+    metrics->Set(charCode, glyph_index, Glyph->AdvanceX());
+    if (diskCache) {
+        FT_BitmapGlyph bitmapGlyph = (FT_BitmapGlyph)ftGlyph;
+        sOglGlyphCacheEntry entry = { charCode, glyph_index, Glyph->BearingLeft(), Glyph->BearingTop(),
+                                      Glyph->Width(), Glyph->Height(), Glyph->AdvanceX(), 0, 0 };
+        diskCache->Add(entry, bitmapGlyph->bitmap.buffer, abs(bitmapGlyph->bitmap.pitch));
+    }
+    FT_Done_Glyph(ftGlyph);
+
+    return Glyph;
+}
+
+//gives an evicted glyph its texture back
+void cOglFont::Reload(cOglGlyph *glyph) const {
+    const sOglGlyphCacheEntry *entry = diskCache ? diskCache->Find(glyph->CharCode()) : NULL;
+    if (entry) {
+        glyph->LoadTexture(diskCache->Bitmap(entry));
+        return;
+    }
+    FT_Glyph ftGlyph = Rasterize(glyph->GlyphIndex());
+    if (!ftGlyph)
+        return;
+    glyph->LoadTexture(((FT_BitmapGlyph)ftGlyph)->bitmap.buffer);
+    FT_Done_Glyph(ftGlyph);
+}
+
+//strokes and renders a glyph into a FT_BitmapGlyph, to be freed with FT_Done_Glyph()
+FT_Glyph cOglFont::Rasterize(FT_UInt glyph_index) const {
+    if (!face)
+        return NULL;
+    //the face is shared by all sizes of the font file
+    FT_Activate_Size(ftSize);
     FT_Int32 loadFlags = FT_LOAD_NO_BITMAP;
     // Load glyph image into the slot (erase previous one):
     int error = FT_Load_Glyph(face, glyph_index, loadFlags);
@@ -597,20 +1805,6 @@ cOglGlyph* cOglFont::Glyph(uint charCode) const {
     }
 
     FT_Glyph ftGlyph;
-    FT_Stroker stroker;
-    error = FT_Stroker_New( ftLib, &stroker );
-    if (error) {
-        esyslog("[openglosd]FT_Stroker_New FT_Error (0x%02x) : %s\n", FT_Errors[error].code, FT_Errors[error].message);
-        return NULL;
-    }
-    float outlineWidth = 0.25f;
-    FT_Stroker_Set(stroker,
-                    (int)(outlineWidth * 64),
-                    FT_STROKER_LINECAP_ROUND,
-                    FT_STROKER_LINEJOIN_ROUND,
-                    0);
-
-    
     error = FT_Get_Glyph(face->glyph, &ftGlyph);
     if (error) {
         esyslog("[openglosd]FT_Get_Glyph FT_Error (0x%02x) : %s\n", FT_Errors[error].code, FT_Errors[error].message);
@@ -622,42 +1816,39 @@ cOglGlyph* cOglFont::Glyph(uint charCode) const {
         esyslog("[openglosd]FT_Glyph_StrokeBorder FT_Error (0x%02x) : %s\n", FT_Errors[error].code, FT_Errors[error].message);
         return NULL;
     }
-    FT_Stroker_Done(stroker);
 
     error = FT_Glyph_To_Bitmap( &ftGlyph, FT_RENDER_MODE_NORMAL, 0, 1);
     if (error) {
         esyslog("[openglosd]FT_Glyph_To_Bitmap FT_Error (0x%02x) : %s\n", FT_Errors[error].code, FT_Errors[error].message);
         return NULL;
     }
-
-    cOglGlyph *Glyph = new cOglGlyph(charCode, (FT_BitmapGlyph)ftGlyph);
-    glyphCache.Add(Glyph);
-    FT_Done_Glyph(ftGlyph);
-
-    return Glyph;
+    return ftGlyph;
 }
 
-int cOglFont::Kerning(cOglGlyph *glyph, uint prevSym) const {
-    int kerning = 0;
-    if (glyph && prevSym) {
-        kerning = glyph->GetKerningCache(prevSym);
-        if (kerning == KERNING_UNKNOWN) {
-            FT_Vector delta;
-            FT_UInt glyph_index = FT_Get_Char_Index(face, glyph->CharCode());
-            FT_UInt glyph_index_prev = FT_Get_Char_Index(face, prevSym);
-            FT_Get_Kerning(face, glyph_index_prev, glyph_index, FT_KERNING_DEFAULT, &delta);
-            kerning = delta.x / 64;
-            glyph->SetKerningCache(prevSym, kerning);
-        }
-    }
+int cOglFont::Kerning(cOglGlyph *glyph, cOglGlyph *prevGlyph) const {
+    if (!hasKerning || !glyph || !prevGlyph)
+        return 0;
+    uint64_t key = ((uint64_t)prevGlyph->GlyphIndex() << 32) | glyph->GlyphIndex();
+    std::unordered_map<uint64_t, int>::const_iterator it = kerningTable.find(key);
+    if (it != kerningTable.end())
+        return it->second;
+    FT_Vector delta;
+    FT_Activate_Size(ftSize);
+    FT_Get_Kerning(face, prevGlyph->GlyphIndex(), glyph->GlyphIndex(), FT_KERNING_DEFAULT, &delta);
+    int kerning = delta.x / 64;
+    kerningTable[key] = kerning;
     return kerning;
 }
 
 /****************************************************************************************
 * cOglFb
 ****************************************************************************************/
+static cOglFbPool *FbPool = NULL;
+static cOglFbMemory *FbMemory = NULL;
+
 cOglFb::cOglFb(GLint width, GLint height, GLint viewPortWidth, GLint viewPortHeight) {
     initiated = false;
+    complete = false;
     fb = 0;
     texture = 0;
     this->width = width;
@@ -668,15 +1859,40 @@ cOglFb::cOglFb(GLint width, GLint height, GLint viewPortWidth, GLint viewPortHei
         scrollable = true;
     else
         scrollable = false;
+    hidden = false;
+    evicted = false;
+    backup = NULL;
+    lastUsed = 0;
 }
 
 cOglFb::~cOglFb(void) {
+    if (initiated && FbMemory)
+        FbMemory->Remove(this);
+    free(backup);
+    if (evicted)
+        return;
+    //only complete framebuffers set up by cOglFb::Init() are handed back to the pool
+    if (complete && FbPool && FbPool->Put(width, height, fb, texture))
+        return;
     GL_CHECK(glDeleteTextures(1, &texture));
     GL_CHECK(glDeleteFramebuffers(1, &fb));
 }
 
 bool cOglFb::Init(void) {
+    if (!initiated && FbMemory)
+        FbMemory->Add(this);
     initiated = true;
+    lastUsed = cTimeMs::Now();
+    complete = false;
+    if (FbPool && FbPool->Get(width, height, fb, texture)) {
+        //recycled framebuffer, clear the content of its previous owner
+        GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
+        GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, fb));
+        GL_CHECK(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
+        GL_CHECK(glClear(GL_COLOR_BUFFER_BIT));
+        complete = true;
+        return true;
+    }
     GL_CHECK(glGenTextures(1, &texture));
     GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
     GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL));
@@ -700,17 +1916,57 @@ bool cOglFb::Init(void) {
         esyslog("[openglosd]ERROR: Framebuffer is not complete!\n");
         return false;
     }
+    complete = true;
+    return true;
+}
+
+bool cOglFb::Evict(void) {
+    if (!initiated || evicted)
+        return false;
+    backup = MALLOC(GLubyte, Size());
+    if (!backup)
+        return false;
+    //keep a copy of the content, the framebuffer gets restored from it when used again
+    GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, fb));
+    GL_CHECK(glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, backup));
+    GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    GL_CHECK(glDeleteTextures(1, &texture));
+    GL_CHECK(glDeleteFramebuffers(1, &fb));
+    texture = 0;
+    fb = 0;
+    evicted = true;
     return true;
 }
 
+void cOglFb::Restore(void) {
+    //restoring may happen while another framebuffer is bound for drawing
+    GLint boundFb;
+    GL_CHECK(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &boundFb));
+    evicted = false;
+    Init();
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
+    GL_CHECK(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, backup));
+    GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, boundFb));
+    free(backup);
+    backup = NULL;
+    if (FbMemory)
+        FbMemory->Restored(this);
+}
+
 void cOglFb::Bind(void) {
     if (!initiated)
         Init();
+    else if (evicted)
+        Restore();
+    lastUsed = cTimeMs::Now();
     GL_CHECK(glViewport(0, 0, width, height));
     GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, fb));
 }
 
 void cOglFb::BindRead(void) {
+    if (evicted)
+        Restore();
+    lastUsed = cTimeMs::Now();
 #ifdef USE_GLES2
     GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, fb));
 #else
@@ -734,6 +1990,9 @@ void cOglFb::Unbind(void) {
 bool cOglFb::BindTexture(void) {
     if (!initiated)
         return false;
+    if (evicted)
+        Restore();
+    lastUsed = cTimeMs::Now();
     GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
     return true;
 }
@@ -745,11 +2004,385 @@ void cOglFb::Blit(GLint destX1, GLint destY1, GLint destX2, GLint destY2) {
 }
 #endif
 
+/****************************************************************************************
+* cOglFbPool
+****************************************************************************************/
+cOglFbPool::cOglFbPool(long maxPoolSize, int maxAge) {
+    this->maxPoolSize = maxPoolSize;
+    this->maxAge = maxAge;
+    memPooled = 0;
+    hits = 0;
+    misses = 0;
+    trimTimer.Set(1000);
+}
+
+cOglFbPool::~cOglFbPool(void) {
+    dsyslog("[openglosd]framebuffer pool: %d hits, %d misses", hits, misses);
+    Clear();
+}
+
+bool cOglFbPool::Get(GLint width, GLint height, GLuint &fb, GLuint &texture) {
+    std::map<uint64_t, std::vector<sOglPooledFb> >::iterator it = buckets.find(Key(width, height));
+    if (it == buckets.end() || it->second.empty()) {
+        misses++;
+        return false;
+    }
+    //take the most recently returned one, the older ones are candidates for trimming
+    sOglPooledFb &entry = it->second.back();
+    fb = entry.fb;
+    texture = entry.texture;
+    it->second.pop_back();
+    memPooled -= Size(it->first);
+    hits++;
+    return true;
+}
+
+bool cOglFbPool::Put(GLint width, GLint height, GLuint fb, GLuint texture) {
+    uint64_t key = Key(width, height);
+    long size = Size(key);
+    if (!fb || !texture || size > maxPoolSize)
+        return false;
+    while (memPooled + size > maxPoolSize)
+        if (!DeleteOldest())
+            return false;
+    sOglPooledFb entry = { fb, texture, cTimeMs::Now() };
+    buckets[key].push_back(entry);
+    memPooled += size;
+    return true;
+}
+
+bool cOglFbPool::DeleteOldest(void) {
+    std::map<uint64_t, std::vector<sOglPooledFb> >::iterator oldest = buckets.end();
+    for (std::map<uint64_t, std::vector<sOglPooledFb> >::iterator it = buckets.begin(); it != buckets.end(); ++it) {
+        if (it->second.empty())
+            continue;
+        if (oldest == buckets.end() || it->second.front().lastUsed < oldest->second.front().lastUsed)
+            oldest = it;
+    }
+    if (oldest == buckets.end())
+        return false;
+    sOglPooledFb &entry = oldest->second.front();
+    GL_CHECK(glDeleteTextures(1, &entry.texture));
+    GL_CHECK(glDeleteFramebuffers(1, &entry.fb));
+    oldest->second.erase(oldest->second.begin());
+    memPooled -= Size(oldest->first);
+    return true;
+}
+
+void cOglFbPool::Trim(void) {
+    if (!trimTimer.TimedOut())
+        return;
+    trimTimer.Set(1000);
+    uint64_t now = cTimeMs::Now();
+    for (std::map<uint64_t, std::vector<sOglPooledFb> >::iterator it = buckets.begin(); it != buckets.end(); ) {
+        std::vector<sOglPooledFb> &bucket = it->second;
+        //entries are ordered by age, the oldest ones come first
+        while (!bucket.empty() && now - bucket.front().lastUsed > (uint64_t)maxAge) {
+            GL_CHECK(glDeleteTextures(1, &bucket.front().texture));
+            GL_CHECK(glDeleteFramebuffers(1, &bucket.front().fb));
+            bucket.erase(bucket.begin());
+            memPooled -= Size(it->first);
+        }
+        if (bucket.empty())
+            buckets.erase(it++);
+        else
+            ++it;
+    }
+}
+
+void cOglFbPool::Clear(void) {
+    for (std::map<uint64_t, std::vector<sOglPooledFb> >::iterator it = buckets.begin(); it != buckets.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); i++) {
+            GL_CHECK(glDeleteTextures(1, &it->second[i].texture));
+            GL_CHECK(glDeleteFramebuffers(1, &it->second[i].fb));
+        }
+    }
+    buckets.clear();
+    memPooled = 0;
+}
+
+/****************************************************************************************
+* cOglFbMemory
+****************************************************************************************/
+cOglFbMemory::cOglFbMemory(long maxMemSize) {
+    this->maxMemSize = maxMemSize;
+    memUsed = 0;
+    memPeak = 0;
+    evictions = 0;
+    restores = 0;
+    restored = NULL;
+    warned = false;
+}
+
+cOglFbMemory::~cOglFbMemory(void) {
+    dsyslog("[openglosd]framebuffer memory: peak %.2fMB, %d evictions, %d restores",
+            memPeak / 1024.0f / 1024.0f, evictions, restores);
+}
+
+void cOglFbMemory::Add(cOglFb *fb) {
+    fbs.push_back(fb);
+    memUsed += fb->Size();
+    memPeak = std::max(memPeak, memUsed + (FbPool ? FbPool->MemPooled() : 0));
+}
+
+void cOglFbMemory::Remove(cOglFb *fb) {
+    std::vector<cOglFb *>::iterator it = std::find(fbs.begin(), fbs.end(), fb);
+    if (it == fbs.end())
+        return;
+    fbs.erase(it);
+    if (!fb->Evicted())
+        memUsed -= fb->Size();
+    if (restored == fb)
+        restored = NULL;
+}
+
+void cOglFbMemory::Restored(cOglFb *fb) {
+    restores++;
+    restored = fb;
+    memUsed += fb->Size();
+    memPeak = std::max(memPeak, memUsed + (FbPool ? FbPool->MemPooled() : 0));
+}
+
+void cOglFbMemory::Enforce(void) {
+    if (!maxMemSize)
+        return;
+    //unused framebuffers in the pool go first
+    while (FbPool && memUsed + FbPool->MemPooled() > maxMemSize)
+        if (!FbPool->Shrink())
+            break;
+    //then the least recently used hidden ones, which have not been drawn lately and
+    //were not just restored, a pixmap being drawn while hidden would bounce otherwise
+    cOglFb *justRestored = restored;
+    restored = NULL;
+    uint64_t now = cTimeMs::Now();
+    while (memUsed > maxMemSize) {
+        cOglFb *victim = NULL;
+        bool busy = false;
+        for (size_t i = 0; i < fbs.size(); i++) {
+            if (!fbs[i]->Hidden() || fbs[i]->Evicted())
+                continue;
+            if (fbs[i] == justRestored || now - fbs[i]->LastUsed() < OGL_FBMEMORY_MIN_IDLE) {
+                busy = true;
+                continue;
+            }
+            if (!victim || fbs[i]->LastUsed() < victim->LastUsed())
+                victim = fbs[i];
+        }
+        //retried once the hidden framebuffers got idle
+        if (!victim && busy)
+            return;
+        if (!victim || !victim->Evict()) {
+            if (!warned)
+                esyslog("[openglosd]framebuffer memory budget of %.2fMB exceeded, used: %.2fMB",
+                        maxMemSize / 1024.0f / 1024.0f, memUsed / 1024.0f / 1024.0f);
+            warned = true;
+            return;
+        }
+        memUsed -= victim->Size();
+        evictions++;
+    }
+    warned = false;
+}
+
+/****************************************************************************************
+* cOglTextureCache
+****************************************************************************************/
+cOglTextureCache::cOglTextureCache(long maxMemSize) {
+    this->maxMemSize = maxMemSize;
+    memUsed = 0;
+    tick = 0;
+    hits = 0;
+    misses = 0;
+    uploaded = 0;
+}
+
+uint64_t cOglTextureCache::Key(const tColor *argb, int width, int height) {
+    //hashes 64 bit words, the dimensions are part of the key
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    uint64_t h = ((uint64_t)width << 32) ^ (uint64_t)height ^ 0x9e3779b97f4a7c15ULL;
+    const unsigned char *p = (const unsigned char *)argb;
+    size_t len = (size_t)width * height * sizeof(tColor);
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t k;
+        memcpy(&k, p + i, sizeof(k));
+        k *= m;
+        k ^= k >> 47;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    if (i < len) {
+        uint32_t k;
+        memcpy(&k, p + i, sizeof(k));
+        h ^= k;
+        h *= m;
+    }
+    h ^= h >> 47;
+    h *= m;
+    h ^= h >> 47;
+    return h;
+}
+
+GLuint cOglTextureCache::Acquire(uint64_t key, int width, int height) {
+    cMutexLock lock(&mutex);
+    std::map<uint64_t, sOglCachedTexture>::iterator it = textures.find(key);
+    if (it == textures.end() || it->second.width != width || it->second.height != height) {
+        misses++;
+        uploaded += width * height * sizeof(tColor);
+        return GL_NONE;
+    }
+    hits++;
+    it->second.pins++;
+    it->second.lastUsed = ++tick;
+    return it->second.texture;
+}
+
+void cOglTextureCache::Release(uint64_t key) {
+    cMutexLock lock(&mutex);
+    std::map<uint64_t, sOglCachedTexture>::iterator it = textures.find(key);
+    if (it != textures.end() && it->second.pins > 0)
+        it->second.pins--;
+}
+
+bool cOglTextureCache::Evict(void) {
+    std::map<uint64_t, sOglCachedTexture>::iterator oldest = textures.end();
+    for (std::map<uint64_t, sOglCachedTexture>::iterator it = textures.begin(); it != textures.end(); ++it) {
+        if (it->second.pins == 0 && (oldest == textures.end() || it->second.lastUsed < oldest->second.lastUsed))
+            oldest = it;
+    }
+    if (oldest == textures.end())
+        return false;
+    GL_CHECK(glDeleteTextures(1, &oldest->second.texture));
+    memUsed -= oldest->second.width * oldest->second.height * sizeof(tColor);
+    textures.erase(oldest);
+    return true;
+}
+
+bool cOglTextureCache::Insert(uint64_t key, GLuint texture, int width, int height) {
+    cMutexLock lock(&mutex);
+    long size = width * height * sizeof(tColor);
+    //the same image may have been queued twice before the first one got cached
+    if (size > maxMemSize || textures.find(key) != textures.end())
+        return false;
+    while (memUsed + size > maxMemSize)
+        if (!Evict())
+            return false;
+    sOglCachedTexture &entry = textures[key];
+    entry.texture = texture;
+    entry.width = width;
+    entry.height = height;
+    entry.pins = 0;
+    entry.lastUsed = ++tick;
+    memUsed += size;
+    return true;
+}
+
+void cOglTextureCache::Clear(void) {
+    cMutexLock lock(&mutex);
+    for (std::map<uint64_t, sOglCachedTexture>::iterator it = textures.begin(); it != textures.end(); ++it)
+        GL_CHECK(glDeleteTextures(1, &it->second.texture));
+    textures.clear();
+    memUsed = 0;
+}
+
+void cOglTextureCache::LogStats(void) {
+    cMutexLock lock(&mutex);
+    dsyslog("[openglosd]texture cache: %d entries, %.2fMB, %d hits, %d misses, %.2fMB uploaded",
+            (int)textures.size(), memUsed / 1024.0f / 1024.0f, hits, misses, uploaded / 1024.0f / 1024.0f);
+}
+
+/****************************************************************************************
+* cOglTextLayoutCache
+****************************************************************************************/
+cOglTextLayoutCache::cOglTextLayoutCache(void) {
+    hits = 0;
+    misses = 0;
+    buildTime = 0;
+}
+
+uint64_t cOglTextLayoutCache::Key(int font, const char *text) {
+    uint64_t hash = 14695981039346656037ULL ^ (uint64_t)font;
+    for (const uchar *p = (const uchar *)text; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+//called by the drawing threads
+std::shared_ptr<sOglTextLayout> cOglTextLayoutCache::Get(int font, const char *text) {
+    if (!text)
+        text = "";
+    uint64_t key = Key(font, text);
+    {
+        cMutexLock lock(&mutex);
+        auto range = index.equal_range(key);
+        for (auto it = range.first; it != range.second; ++it) {
+            std::shared_ptr<sOglTextLayout> &layout = *it->second;
+            if (layout->font == font && layout->text == text) {
+                layouts.splice(layouts.begin(), layouts, it->second);
+                hits++;
+                return layout;
+            }
+        }
+    }
+    //decode and measure without holding the lock
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::shared_ptr<sOglTextLayout> layout = std::make_shared<sOglTextLayout>();
+    layout->font = font;
+    layout->text = text;
+    int len = Utf8StrLen(text);
+    layout->symbols.resize(len + 1);
+    if (len)
+        Utf8ToArray(text, &layout->symbols[0], len + 1);
+    layout->symbols[len] = 0;
+    layout->width = cOglFont::Width(font, &layout->symbols[0]);
+    layout->laidOut = false;
+    long elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    cMutexLock lock(&mutex);
+    misses++;
+    buildTime += elapsed;
+    layouts.push_front(layout);
+    index.insert(std::make_pair(key, layouts.begin()));
+    if ((int)layouts.size() > OGL_TEXTLAYOUT_MAX_ENTRIES) {
+        //commands still holding the oldest layout keep it alive
+        std::list<std::shared_ptr<sOglTextLayout> >::iterator last = --layouts.end();
+        auto range = index.equal_range(Key((*last)->font, (*last)->text.c_str()));
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == last) {
+                index.erase(it);
+                break;
+            }
+        }
+        layouts.erase(last);
+    }
+    return layout;
+}
+
+void cOglTextLayoutCache::LogStats(void) {
+    cMutexLock lock(&mutex);
+    if (!hits && !misses)
+        return;
+    //a hit saves about what a miss costs
+    dsyslog("[openglosd]text layout cache: %d entries, %d hits, %d misses, %.2fms built, about %.2fms saved",
+            (int)layouts.size(), hits, misses, buildTime / 1000.0f, misses ? (float)buildTime * hits / misses / 1000.0f : 0.0f);
+}
+
 /****************************************************************************************
 * cOglOutputFb
 ****************************************************************************************/
-cOglOutputFb::cOglOutputFb(GLint width, GLint height) : cOglFb(width, height, width, height) {
-    surface = 0;
+cOglOutputFb::cOglOutputFb(const char *name, GLint width, GLint height) : cOglFb(width, height, width, height) {
+    this->name = name;
+    for (int i = 0; i < OGL_OUTPUT_SURFACES; i++) {
+        textures[i] = 0;
+        fbs[i] = 0;
+    }
+    numSurfaces = 0;
+    back = 0;
+    frames = 0;
+    frameTime = 0;
 #ifdef USE_GLES2
     this->width = width;
     this->height = height;
@@ -757,68 +2390,434 @@ cOglOutputFb::cOglOutputFb(GLint width, GLint height) : cOglFb(width, height, wi
 }
 
 cOglOutputFb::~cOglOutputFb(void) {
+    //texture and fb of the back surface are deleted by cOglFb
+    for (int i = 0; i < numSurfaces; i++) {
+        if (i == back)
+            continue;
+        GL_CHECK(glDeleteTextures(1, &textures[i]));
+        GL_CHECK(glDeleteFramebuffers(1, &fbs[i]));
+    }
+    if (frames)
+        dsyslog("[openglosd]%s output: %d surface(s), %d frames, %.2fms per frame",
+                Name(), numSurfaces, frames, (double)frameTime / frames);
+}
+
+cOglOutputFb *cOglOutputFb::Create(int backend, GLint width, GLint height) {
+    switch (backend) {
 #ifdef USE_GLES2
-    eglReleaseContext();
+    case obDmaBuf:
+        return new cOglOutputFbDmaBuf(width, height);
 #endif
-    glVDPAUUnregisterSurfaceNV(surface);
+    case obReadback:
+        return new cOglOutputFbReadback(width, height);
+    default:
+        return new cOglOutputFbVdpau(width, height);
+    }
+}
+
+//textures of backends which are not backed by the output device
+void cOglOutputFb::AllocTextures(void) {
+    GL_CHECK(glGenTextures(numSurfaces, textures));
+    for (int i = 0; i < numSurfaces; i++) {
+        GL_CHECK(glBindTexture(GL_TEXTURE_2D, textures[i]));
+        GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    }
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+bool cOglOutputFb::InitFramebuffers(void) {
+    GL_CHECK(glGenFramebuffers(numSurfaces, fbs));
+    for (int i = 0; i < numSurfaces; i++) {
+        GL_CHECK(glBindTexture(GL_TEXTURE_2D, textures[i]));
+        GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, fbs[i]));
+        GL_CHECK(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[i], 0));
+
+        GLenum fbstatus;
+        GL_CHECK(fbstatus = glCheckFramebufferStatus(GL_FRAMEBUFFER));
+        if(fbstatus != GL_FRAMEBUFFER_COMPLETE) {
+            esyslog("[openglosd]ERROR::cOglOutputFb: Framebuffer is not complete!");
+            return false;
+        }
+        //parts not covered by any osd are never drawn
+        GL_CHECK(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
+        GL_CHECK(glClear(GL_COLOR_BUFFER_BIT));
+    }
+    SelectSurface(0);
+    return true;
+}
+
+void cOglOutputFb::SelectSurface(int index) {
+    back = index;
+    texture = textures[back];
+    fb = fbs[back];
+}
+
+void cOglOutputFb::BindWrite(void) {
 #ifdef USE_GLES2
-    eglAcquireContext();
+    GL_CHECK(glViewport(0, 0, width, height));
+    GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, fb));
+#else
+    GL_CHECK(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fb));
 #endif
 }
 
-bool cOglOutputFb::Init(void) {
-    //fetching osd vdpau output surface from softhddevice
-    void *vdpauOutputSurface = pVMed->GetVDPAUOutputSurface();
-    GL_CHECK(glGenTextures(1, &texture));
+void cOglOutputFb::Unbind(void) {
+    GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+}
+
+void cOglOutputFb::SetSource(cOglFb *fb, GLint x, GLint y) {
+    int all = (1 << numSurfaces) - 1;
+    for (std::vector<sOglOutputSource>::iterator it = sources.begin(); it != sources.end(); ++it) {
+        if (it->fb == fb) {
+            if (it->x != x || it->y != y) {
+                sOglOutputClear clear = { it->x, it->y, fb->Width(), fb->Height(), all };
+                clears.push_back(clear);
+            }
+            it->x = x;
+            it->y = y;
+            it->pending = all;
+            return;
+        }
+    }
+    sOglOutputSource source;
+    source.fb = fb;
+    source.x = x;
+    source.y = y;
+    source.pending = all;
+    sources.push_back(source);
+}
+
+//the pixels of a closed osd stay on every surface until they are cleared
+void cOglOutputFb::RemoveSource(cOglFb *fb) {
+    for (std::vector<sOglOutputSource>::iterator it = sources.begin(); it != sources.end(); ++it) {
+        if (it->fb == fb) {
+            sOglOutputClear clear = { it->x, it->y, fb->Width(), fb->Height(), (1 << numSurfaces) - 1 };
+            clears.push_back(clear);
+            sources.erase(it);
+            return;
+        }
+    }
+}
+
+//clears areas of removed or moved sources on the bound back surface, before the sources are redrawn
+void cOglOutputFb::ClearRemoved(void) {
+    int backMask = 1 << back;
+    bool cleared = false;
+    for (std::vector<sOglOutputClear>::iterator it = clears.begin(); it != clears.end(); ++it) {
+        if (!(it->pending & backMask))
+            continue;
+        if (!cleared) {
+            GL_CHECK(glEnable(GL_SCISSOR_TEST));
+            GL_CHECK(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
+            cleared = true;
+        }
+#ifdef USE_GLES2
+        //sources are placed top down by the projection, the scissor box counts from the bottom
+        GL_CHECK(glScissor(it->x, height - it->y - it->height, it->width, it->height));
+#else
+        GL_CHECK(glScissor(it->x, it->y, it->width, it->height));
+#endif
+        GL_CHECK(glClear(GL_COLOR_BUFFER_BIT));
+        it->pending &= ~backMask;
+    }
+    if (!cleared)
+        return;
+    GL_CHECK(glDisable(GL_SCISSOR_TEST));
+    for (size_t i = 0; i < clears.size(); ) {
+        if (clears[i].pending)
+            i++;
+        else
+            clears.erase(clears.begin() + i);
+    }
+}
+
+void cOglOutputFb::FrameDone(uint64_t start) {
+    frames++;
+    frameTime += cTimeMs::Now() - start;
+}
+
+/****************************************************************************************
+* cOglOutputFbVdpau
+****************************************************************************************/
+cOglOutputFbVdpau::cOglOutputFbVdpau(GLint width, GLint height) : cOglOutputFb("vdpau", width, height) {
+    for (int i = 0; i < OGL_OUTPUT_SURFACES; i++)
+        surfaces[i] = 0;
+    mapped = false;
+    contextSwitches = 0;
+}
+
+cOglOutputFbVdpau::~cOglOutputFbVdpau(void) {
+    ReleaseContext();
+    if (mapped)
+        glVDPAUUnmapSurfacesNV(1, &surfaces[back]);
+    for (int i = 0; i < numSurfaces; i++)
+        glVDPAUUnregisterSurfaceNV(surfaces[i]);
+    AcquireContext();
+    if (frames)
+        dsyslog("[openglosd]vdpau output: %.2f context switches per frame", (double)contextSwitches / frames);
+}
+
+void cOglOutputFbVdpau::ReleaseContext(void) {
 #ifdef USE_GLES2
     eglReleaseContext();
+    contextSwitches++;
 #endif
-    //register surface for texture
-    surface = glVDPAURegisterOutputSurfaceNV(vdpauOutputSurface, GL_TEXTURE_2D, 1, &texture);
-    //set write access to surface
-    glVDPAUSurfaceAccessNV(surface, GL_WRITE_DISCARD_NV);
-    //create framebuffer
-    glVDPAUMapSurfacesNV (1, &surface);
+}
+
+void cOglOutputFbVdpau::AcquireContext(void) {
 #ifdef USE_GLES2
     eglAcquireContext();
 #endif
-    GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
-    GL_CHECK(glGenFramebuffers(1, &fb));
-    GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, fb));
-    GL_CHECK(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0));
+}
 
-    GLenum fbstatus;
-    GL_CHECK(fbstatus = glCheckFramebufferStatus(GL_FRAMEBUFFER));
-    if(fbstatus != GL_FRAMEBUFFER_COMPLETE) {
-        esyslog("[openglosd]ERROR::cOglOutputFb: Framebuffer is not complete!");
+bool cOglOutputFbVdpau::Init(void) {
+    //fetching osd vdpau output surfaces from the output device, a second one allows double buffering
+    void *vdpauOutputSurfaces[OGL_OUTPUT_SURFACES];
+    numSurfaces = 0;
+    int wanted = constrain(pVMed->VDPAUOutputSurfaces(), 1, OGL_OUTPUT_SURFACES);
+    for (int i = 0; i < wanted; i++) {
+        vdpauOutputSurfaces[i] = pVMed->GetVDPAUOutputSurfaceAt(i);
+        if (!vdpauOutputSurfaces[i])
+            break;
+        numSurfaces++;
+    }
+    if (!numSurfaces) {
+        esyslog("[openglosd]ERROR::cOglOutputFb: no output surface available!");
         return false;
     }
+    GL_CHECK(glGenTextures(numSurfaces, textures));
+    ReleaseContext();
+    for (int i = 0; i < numSurfaces; i++) {
+        //register surface for texture
+        surfaces[i] = glVDPAURegisterOutputSurfaceNV(vdpauOutputSurfaces[i], GL_TEXTURE_2D, 1, &textures[i]);
+        //set write access to surface
+        glVDPAUSurfaceAccessNV(surfaces[i], GL_WRITE_DISCARD_NV);
+    }
+    //create framebuffers
+    glVDPAUMapSurfacesNV(numSurfaces, surfaces);
+    AcquireContext();
+    mapped = true;
+    if (!InitFramebuffers())
+        return false;
+    //the back surface stays mapped while double buffering, the others go to the mixer
+    if (numSurfaces > 1) {
+        ReleaseContext();
+        glVDPAUUnmapSurfacesNV(numSurfaces - 1, &surfaces[1]);
+        AcquireContext();
+    }
+    dsyslog("[openglosd]using %d output surface(s)", numSurfaces);
     return true;
 }
 
-void cOglOutputFb::BindWrite(void) {
+void cOglOutputFbVdpau::BindWrite(void) {
+    if (!mapped) {
+        ReleaseContext();
+        glVDPAUMapSurfacesNV(1, &surfaces[back]);
+        AcquireContext();
+        mapped = true;
+    }
+    cOglOutputFb::BindWrite();
+}
+
+void cOglOutputFbVdpau::Unbind(void) {
+    //a single surface is shared with the mixer, so it is only mapped while drawing
+    if (mapped && numSurfaces == 1) {
+        ReleaseContext();
+        glVDPAUUnmapSurfacesNV(1, &surfaces[back]);
+        AcquireContext();
+        mapped = false;
+    }
+    cOglOutputFb::Unbind();
+}
+
+void cOglOutputFbVdpau::Present(void) {
+    if (numSurfaces == 1) {
+        pVMed->ActivateOsd();
+        return;
+    }
+    //hand the back surface over and map the next one, in one go with the context released
+    ReleaseContext();
+    if (mapped)
+        glVDPAUUnmapSurfacesNV(1, &surfaces[back]);
+    pVMed->ActivateOsdSurface(back);
+    int next = (back + 1) % numSurfaces;
+    glVDPAUMapSurfacesNV(1, &surfaces[next]);
+    AcquireContext();
+    mapped = true;
+    SelectSurface(next);
+}
+
 #ifdef USE_GLES2
-    eglReleaseContext();
+/****************************************************************************************
+* cOglOutputFbDmaBuf
+****************************************************************************************/
+static PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHRProc;
+static PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHRProc;
+static PFNEGLEXPORTDMABUFIMAGEQUERYMESAPROC eglExportDMABUFImageQueryMESAProc;
+static PFNEGLEXPORTDMABUFIMAGEMESAPROC eglExportDMABUFImageMESAProc;
+
+cOglOutputFbDmaBuf::cOglOutputFbDmaBuf(GLint width, GLint height) : cOglOutputFb("dma-buf", width, height) {
+    for (int i = 0; i < OGL_OUTPUT_SURFACES; i++) {
+        images[i] = EGL_NO_IMAGE_KHR;
+        fds[i] = -1;
+        strides[i] = 0;
+        offsets[i] = 0;
+    }
+    fourcc = 0;
+    modifier = 0;
+}
+
+cOglOutputFbDmaBuf::~cOglOutputFbDmaBuf(void) {
+    for (int i = 0; i < numSurfaces; i++) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+        if (images[i] != EGL_NO_IMAGE_KHR)
+            eglDestroyImageKHRProc(eglDisplay, images[i]);
+    }
+}
+
+bool cOglOutputFbDmaBuf::Init(void) {
+    eglCreateImageKHRProc = (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress("eglCreateImageKHR");
+    eglDestroyImageKHRProc = (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress("eglDestroyImageKHR");
+    eglExportDMABUFImageQueryMESAProc = (PFNEGLEXPORTDMABUFIMAGEQUERYMESAPROC)eglGetProcAddress("eglExportDMABUFImageQueryMESA");
+    eglExportDMABUFImageMESAProc = (PFNEGLEXPORTDMABUFIMAGEMESAPROC)eglGetProcAddress("eglExportDMABUFImageMESA");
+    if (!eglCreateImageKHRProc || !eglDestroyImageKHRProc || !eglExportDMABUFImageQueryMESAProc || !eglExportDMABUFImageMESAProc) {
+        esyslog("[openglosd]ERROR::cOglOutputFbDmaBuf: dma-buf export not supported");
+        return false;
+    }
+    //the output device scans out one buffer while we render into the other
+    numSurfaces = OGL_OUTPUT_SURFACES;
+    AllocTextures();
+    if (!InitFramebuffers())
+        return false;
+    for (int i = 0; i < numSurfaces; i++) {
+        EGL_CHECK(images[i] = eglCreateImageKHRProc(eglDisplay, eglContext, EGL_GL_TEXTURE_2D_KHR, (EGLClientBuffer)(intptr_t)textures[i], NULL));
+        if (images[i] == EGL_NO_IMAGE_KHR) {
+            esyslog("[openglosd]ERROR::cOglOutputFbDmaBuf: cannot create EGLImage");
+            return false;
+        }
+        int planes = 0;
+        if (!eglExportDMABUFImageQueryMESAProc(eglDisplay, images[i], &fourcc, &planes, &modifier) || planes != 1) {
+            esyslog("[openglosd]ERROR::cOglOutputFbDmaBuf: cannot export a single plane dma-buf");
+            return false;
+        }
+        if (!eglExportDMABUFImageMESAProc(eglDisplay, images[i], &fds[i], &strides[i], &offsets[i])) {
+            esyslog("[openglosd]ERROR::cOglOutputFbDmaBuf: dma-buf export failed");
+            return false;
+        }
+    }
+    dsyslog("[openglosd]exported %d osd dma-bufs, fourcc 0x%08x, modifier 0x%llx", numSurfaces, fourcc, (unsigned long long)modifier);
+    return true;
+}
+
+void cOglOutputFbDmaBuf::Present(void) {
+    //without fences shared with the output device, rendering has to be complete before the handover
+    GL_CHECK(glFinish());
+    pVMed->ActivateOsdDmaBuf(fds[back], fourcc, modifier, width, height, strides[back], offsets[back]);
+    SelectSurface((back + 1) % numSurfaces);
+}
+#endif
+
+/****************************************************************************************
+* cOglOutputFbReadback
+****************************************************************************************/
+cOglOutputFbReadback::cOglOutputFbReadback(GLint width, GLint height) : cOglOutputFb("readback", width, height) {
+#ifdef USE_GLES2
+    pixels = NULL;
+#else
+    pbos[0] = pbos[1] = 0;
+    fences[0] = fences[1] = 0;
+    first = 0;
+    inFlight = 0;
 #endif
-    glVDPAUMapSurfacesNV(1, &surface);
+}
+
+cOglOutputFbReadback::~cOglOutputFbReadback(void) {
 #ifdef USE_GLES2
-    eglAcquireContext();
-    GL_CHECK(glViewport(0, 0, width, height));
+    free(pixels);
+#else
+    for (int i = 0; i < inFlight; i++)
+        GL_CHECK(glDeleteSync(fences[(first + i) % 2]));
+    GL_CHECK(glDeleteBuffers(2, pbos));
+#endif
+}
+
+bool cOglOutputFbReadback::Init(void) {
+    //one surface is enough, the output device gets a copy
+    numSurfaces = 1;
+    AllocTextures();
+    if (!InitFramebuffers())
+        return false;
+#ifndef USE_GLES2
+    GL_CHECK(glGenBuffers(2, pbos));
+#endif
+    return true;
+}
+
+void cOglOutputFbReadback::Present(void) {
+#ifdef USE_GLES2
+    //GLES2 has no pixel buffer objects, the readback is synchronous
+    tColor *dst = pVMed->GetOsdPixelBuffer(width, height);
+    if (!dst) {
+        if (!pixels)
+            pixels = MALLOC(tColor, width * height);
+        dst = pixels;
+    }
     GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, fb));
+    GL_CHECK(glReadPixels(0, 0, width, height, OGL_IMAGE_FORMAT, OGL_IMAGE_TYPE, dst));
+    GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    pVMed->ActivateOsd();
 #else
-    GL_CHECK(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fb));
+    //both buffers busy, the oldest frame has to be delivered first
+    if (inFlight == 2)
+        Deliver();
+    int slot = (first + inFlight) % 2;
+    GL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]));
+    GL_CHECK(glBufferData(GL_PIXEL_PACK_BUFFER, (long)width * height * sizeof(tColor), NULL, GL_STREAM_READ));
+    GL_CHECK(glBindFramebuffer(GL_READ_FRAMEBUFFER, fb));
+    //returns right away, the transfer is done by the driver
+    GL_CHECK(glReadPixels(0, 0, width, height, OGL_IMAGE_FORMAT, OGL_IMAGE_TYPE, 0));
+    GL_CHECK(fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    GL_CHECK(glBindFramebuffer(GL_READ_FRAMEBUFFER, 0));
+    GL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+    inFlight++;
 #endif
 }
 
-void cOglOutputFb::Unbind(void) {
-#ifdef USE_GLES2
-    eglReleaseContext();
+#ifndef USE_GLES2
+//hands the oldest readback over, waits for it if necessary
+void cOglOutputFbReadback::Deliver(void) {
+    GL_CHECK(glClientWaitSync(fences[first], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED));
+    GL_CHECK(glDeleteSync(fences[first]));
+    long size = (long)width * height * sizeof(tColor);
+    GL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[first]));
+    const void *src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if (src) {
+        tColor *dst = pVMed->GetOsdPixelBuffer(width, height);
+        if (dst)
+            memcpy(dst, src, size);
+        GL_CHECK(glUnmapBuffer(GL_PIXEL_PACK_BUFFER));
+    }
+    GL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+    first = (first + 1) % 2;
+    inFlight--;
+    pVMed->ActivateOsd();
+}
 #endif
-    glVDPAUUnmapSurfacesNV(1, &surface);
-#ifdef USE_GLES2
-    eglAcquireContext();
+
+bool cOglOutputFbReadback::Finish(void) {
+#ifndef USE_GLES2
+    while (inFlight) {
+        GLenum state;
+        GL_CHECK(state = glClientWaitSync(fences[first], GL_SYNC_FLUSH_COMMANDS_BIT, OGL_READBACK_POLL * 1000000));
+        if (state == GL_TIMEOUT_EXPIRED)
+            return false;
+        Deliver();
+    }
 #endif
-    GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    return true;
 }
 
 /****************************************************************************************
@@ -828,6 +2827,7 @@ static cOglVb *VertexBuffers[vbCount];
 
 cOglVb::cOglVb(int type) {
     this->type = (eVertexBufferType)type;
+    variant = 0;
     positionLoc = 0;
     texCoordsLoc = 1;
 #ifndef USE_GLES2
@@ -880,6 +2880,20 @@ bool cOglVb::Init(void) {
         numVertices = 6;
         drawMode = GL_TRIANGLES;
         shader = stText;
+    } else if (type == vbPixel) {
+        //Pixel VBO definition
+        sizeVertex1 = 2;
+        sizeVertex2 = 4;
+        numVertices = OGL_PIXELBATCH_SIZE;
+        drawMode = GL_POINTS;
+        shader = stPixel;
+    } else if (type == vbPalette) {
+        //Palette VBO definition
+        sizeVertex1 = 2;
+        sizeVertex2 = 2;
+        numVertices = 6;
+        drawMode = GL_TRIANGLES;
+        shader = stPalette;
     }
 
     GL_CHECK(glGenBuffers(1, &vbo));
@@ -929,8 +2943,17 @@ void cOglVb::Unbind(void) {
 #endif
 }
 
-void cOglVb::ActivateShader(void) {
-    Shaders[shader]->Use();
+void cOglVb::ActivateShader(GLint alpha, bool border) {
+    variant = 0;
+    if (alpha < 255)
+        variant |= svAlpha;
+    if (border)
+        variant |= svBorder;
+    variant &= ShaderVariants[shader];
+    //a variant that failed to compile is covered by the generic shader
+    if (!Shaders[shader][variant])
+        variant = ShaderVariants[shader];
+    Shaders[shader][variant]->Use();
 }
 
 void cOglVb::EnableBlending(void) {
@@ -945,28 +2968,40 @@ void cOglVb::DisableBlending(void) {
 void cOglVb::SetShaderColor(GLint color) {
     glm::vec4 col;
     ConvertColor(color, col);
-    Shaders[shader]->SetVector4f("inColor", col.r, col.g, col.b, col.a);
+    Shaders[shader][variant]->SetVector4f("inColor", col.r, col.g, col.b, col.a);
 }
 
 #ifdef USE_GLES2
 void cOglVb::SetShaderBorderColor(GLint color) {
+    if (!(variant & svBorder))
+        return;
     glm::vec4 col;
     ConvertColor(color, col);
-    Shaders[shader]->SetVector4f("bColor", col.r, col.g, col.b, col.a);
+    Shaders[shader][variant]->SetVector4f("bColor", col.r, col.g, col.b, col.a);
 }
 
 void cOglVb::SetShaderTexture(GLint value) {
-    Shaders[shader]->SetInteger("screenTexture", value);
+    Shaders[shader][variant]->SetInteger("screenTexture", value);
 }
 #endif
 
 void cOglVb::SetShaderAlpha(GLint alpha) {
-    Shaders[shader]->SetVector4f("alpha", 1.0f, 1.0f, 1.0f, (GLfloat)(alpha) / 255.0f);
+    if (!(variant & svAlpha))
+        return;
+    Shaders[shader][variant]->SetVector4f("alpha", 1.0f, 1.0f, 1.0f, (GLfloat)(alpha) / 255.0f);
+}
+
+void cOglVb::SetShaderPalette(bool overlay, bool filter, GLint width, GLint height) {
+    Shaders[shader][variant]->SetInteger("indexTexture", 0);
+    Shaders[shader][variant]->SetInteger("paletteTexture", 1);
+    Shaders[shader][variant]->SetFloat("overlay", overlay ? 1.0f : 0.0f);
+    Shaders[shader][variant]->SetFloat("bilinear", filter ? 1.0f : 0.0f);
+    Shaders[shader][variant]->SetVector2f("indexSize", width, height);
 }
 
 void cOglVb::SetShaderProjectionMatrix(GLint width, GLint height) {
     glm::mat4 projection = glm::ortho(0.0f, (GLfloat)width, (GLfloat)height, 0.0f, -1.0f, 1.0f);
-    Shaders[shader]->SetMatrix4("projection", projection);
+    Shaders[shader][variant]->SetMatrix4("projection", projection);
 }
 
 void cOglVb::SetVertexData(GLfloat *vertices, int count) {
@@ -985,6 +3020,12 @@ void cOglVb::DrawArrays(int count) {
 }
 
 
+//the border color is only needed if a quad samples outside of its texture
+static inline bool OutsideTexture(GLfloat texX1, GLfloat texY1, GLfloat texX2, GLfloat texY2) {
+    return std::min(std::min(texX1, texX2), std::min(texY1, texY2)) < 0.0f ||
+           std::max(std::max(texX1, texX2), std::max(texY1, texY2)) > 1.0f;
+}
+
 /****************************************************************************************
 * cOpenGLCmd
 ****************************************************************************************/
@@ -1017,10 +3058,22 @@ cOglCmdDeleteFb::cOglCmdDeleteFb(cOglFb *fb) : cOglCmd(fb) {
 }
 
 bool cOglCmdDeleteFb::Execute(void) {
+    if (cOglOsd::oFb)
+        cOglOsd::oFb->RemoveSource(fb);
     delete fb;
     return true;
 }
 
+//------------------ cOglCmdSetFbHidden --------------------
+cOglCmdSetFbHidden::cOglCmdSetFbHidden(cOglFb *fb, bool hidden) : cOglCmd(fb) {
+    this->hidden = hidden;
+}
+
+bool cOglCmdSetFbHidden::Execute(void) {
+    fb->SetHidden(hidden);
+    return true;
+}
+
 //------------------ cOglCmdRenderFbToBufferFb --------------------
 cOglCmdRenderFbToBufferFb::cOglCmdRenderFbToBufferFb(cOglFb *fb, cOglFb *buffer, GLint x, GLint y, GLint transparency, GLint drawPortX, GLint drawPortY) : cOglCmd(fb) {
     this->buffer = buffer;
@@ -1068,7 +3121,7 @@ bool cOglCmdRenderFbToBufferFb::Execute(void) {
         x2,  y ,  texX2, texY1           //right top
     };
 
-    VertexBuffers[vbTexture]->ActivateShader();
+    VertexBuffers[vbTexture]->ActivateShader(transparency, OutsideTexture(texX1, texY1, texX2, texY2));
     VertexBuffers[vbTexture]->SetShaderAlpha(transparency);
     VertexBuffers[vbTexture]->SetShaderProjectionMatrix(buffer->Width(), buffer->Height());
 #ifdef USE_GLES2
@@ -1087,6 +3140,86 @@ bool cOglCmdRenderFbToBufferFb::Execute(void) {
     return true;
 }
 
+//------------------ cOglCmdCopyFb --------------------
+cOglCmdCopyFb::cOglCmdCopyFb(cOglFb *fb, cOglFb *source, GLint sx, GLint sy, GLint width, GLint height, GLint dx, GLint dy, bool blend) : cOglCmd(fb) {
+    this->source = source;
+    this->sx = sx;
+    this->sy = sy;
+    this->width = width;
+    this->height = height;
+    this->dx = dx;
+    this->dy = dy;
+    this->blend = blend;
+}
+
+bool cOglCmdCopyFb::Execute(void) {
+    if (source != fb)
+        return CopyRect(source, sx, sy, fb, dx, dy);
+    //source and destination overlap, ping-pong through a temporary framebuffer
+    cOglFb *tmp = new cOglFb(width, height, width, height);
+    bool ok = CopyRect(fb, sx, sy, tmp, 0, 0) && CopyRect(tmp, 0, 0, fb, dx, dy);
+    delete tmp;
+    return ok;
+}
+
+bool cOglCmdCopyFb::CopyRect(cOglFb *src, GLint srcX, GLint srcY, cOglFb *dst, GLint dstX, GLint dstY) {
+    //binding creates framebuffers which were never drawn to, so they are transparent
+    src->Bind();
+    dst->Bind();
+#ifndef USE_GLES2
+    if (!blend) {
+        /* framebuffer rows are bottom up */
+        src->BindRead();
+        GL_CHECK(glBlitFramebuffer(srcX, src->Height() - srcY - height, srcX + width, src->Height() - srcY,
+                                   dstX, dst->Height() - dstY - height, dstX + width, dst->Height() - dstY,
+                                   GL_COLOR_BUFFER_BIT, GL_NEAREST));
+        dst->Unbind();
+        return true;
+    }
+#endif
+    GLfloat x1 = dstX;          //left
+    GLfloat y1 = dstY;          //top
+    GLfloat x2 = dstX + width;  //right
+    GLfloat y2 = dstY + height; //bottom
+
+    GLfloat texX1 = (GLfloat)srcX / (GLfloat)src->Width();
+    GLfloat texX2 = (GLfloat)(srcX + width) / (GLfloat)src->Width();
+    /* framebuffer rows are bottom up */
+    GLfloat texY1 = 1.0f - (GLfloat)srcY / (GLfloat)src->Height();
+    GLfloat texY2 = 1.0f - (GLfloat)(srcY + height) / (GLfloat)src->Height();
+
+    GLfloat quadVertices[] = {
+        // Pos    // TexCoords
+        x1,  y1,  texX1, texY1,          //left top
+        x1,  y2,  texX1, texY2,          //left bottom
+        x2,  y2,  texX2, texY2,          //right bottom
+
+        x1,  y1,  texX1, texY1,          //left top
+        x2,  y2,  texX2, texY2,          //right bottom
+        x2,  y1,  texX2, texY1           //right top
+    };
+
+    VertexBuffers[vbTexture]->ActivateShader(255, OutsideTexture(texX1, texY1, texX2, texY2));
+    VertexBuffers[vbTexture]->SetShaderAlpha(255);
+    VertexBuffers[vbTexture]->SetShaderProjectionMatrix(dst->Width(), dst->Height());
+#ifdef USE_GLES2
+    VertexBuffers[vbTexture]->SetShaderBorderColor(BORDERCOLOR);
+#endif
+
+    if (!src->BindTexture())
+        return false;
+    if (!blend)
+        VertexBuffers[vbTexture]->DisableBlending();
+    VertexBuffers[vbTexture]->Bind();
+    VertexBuffers[vbTexture]->SetVertexData(quadVertices);
+    VertexBuffers[vbTexture]->DrawArrays();
+    VertexBuffers[vbTexture]->Unbind();
+    if (!blend)
+        VertexBuffers[vbTexture]->EnableBlending();
+    dst->Unbind();
+    return true;
+}
+
 //------------------ cOglCmdCopyBufferToOutputFb --------------------
 cOglCmdCopyBufferToOutputFb::cOglCmdCopyBufferToOutputFb(cOglFb *fb, cOglOutputFb *oFb, GLint x, GLint y) : cOglCmd(fb) {
     this->oFb = oFb;
@@ -1099,52 +3232,85 @@ cOglCmdCopyBufferToOutputFb::cOglCmdCopyBufferToOutputFb(cOglFb *fb, cOglOutputF
     this->x = x;
     this->y = y;
 #endif
+    presented = false;
+    finished = false;
+    start = 0;
 }
 
 bool cOglCmdCopyBufferToOutputFb::Execute(void) {
+    //an asynchronous output backend may still be delivering the frame
+    if (presented) {
+        finished = oFb->Finish();
+        if (finished)
+            oFb->FrameDone(start);
+        return true;
+    }
+    start = cTimeMs::Now();
+    //with double buffering, the back surface may lack updates of other osds too
+    oFb->SetSource(fb, x, y);
+    int backMask = 1 << oFb->Back();
+    std::vector<sOglOutputSource> &sources = oFb->Sources();
 #ifdef USE_GLES2
-    GLfloat x2 = x + (GLfloat)fb->Width();
-    GLfloat y2 = y + (GLfloat)fb->Height();
-
-    GLfloat texX1 = 0.0f;
-    GLfloat texX2 = 1.0f;
-    /* Do the y-axis flip here */
-    GLfloat texY1 = 1.0f;
-    GLfloat texY2 = 0.0f;
-
-    GLfloat quadVertices[] = {
-        // Pos    // TexCoords
-        x ,  y ,  texX1, texY1,          //left top
-        x ,  y2,  texX1, texY2,          //left bottom
-        x2,  y2,  texX2, texY2,          //right bottom
-
-        x ,  y ,  texX1, texY1,          //left top
-        x2,  y2,  texX2, texY2,          //right bottom
-        x2,  y ,  texX2, texY1           //right top
-    };
-
     VertexBuffers[vbTexture]->ActivateShader();
     VertexBuffers[vbTexture]->SetShaderAlpha(255);
     VertexBuffers[vbTexture]->SetShaderProjectionMatrix(oFb->Width(), oFb->Height());
     VertexBuffers[vbTexture]->SetShaderBorderColor(bcolor);
 
     oFb->BindWrite();
-    if (!fb->BindTexture())
-        return false;
+    oFb->ClearRemoved();
+    for (std::vector<sOglOutputSource>::iterator it = sources.begin(); it != sources.end(); ++it) {
+        if (!(it->pending & backMask))
+            continue;
+        it->pending &= ~backMask;
+        GLfloat x1 = it->x;
+        GLfloat y1 = it->y;
+        GLfloat x2 = x1 + (GLfloat)it->fb->Width();
+        GLfloat y2 = y1 + (GLfloat)it->fb->Height();
+
+        GLfloat texX1 = 0.0f;
+        GLfloat texX2 = 1.0f;
+        /* Do the y-axis flip here */
+        GLfloat texY1 = 1.0f;
+        GLfloat texY2 = 0.0f;
+
+        GLfloat quadVertices[] = {
+            // Pos    // TexCoords
+            x1,  y1,  texX1, texY1,          //left top
+            x1,  y2,  texX1, texY2,          //left bottom
+            x2,  y2,  texX2, texY2,          //right bottom
+
+            x1,  y1,  texX1, texY1,          //left top
+            x2,  y2,  texX2, texY2,          //right bottom
+            x2,  y1,  texX2, texY1           //right top
+        };
 
-    VertexBuffers[vbTexture]->Bind();
-    VertexBuffers[vbTexture]->SetVertexData(quadVertices);
-    VertexBuffers[vbTexture]->DrawArrays();
-    VertexBuffers[vbTexture]->Unbind();
+        if (!it->fb->BindTexture())
+            continue;
+
+        VertexBuffers[vbTexture]->Bind();
+        VertexBuffers[vbTexture]->SetVertexData(quadVertices);
+        VertexBuffers[vbTexture]->DrawArrays();
+        VertexBuffers[vbTexture]->Unbind();
+    }
     GL_CHECK(glFlush());
 #else
-    fb->BindRead();
     oFb->BindWrite();
-    fb->Blit(x, y + fb->Height(), x + fb->Width(), y);
+    oFb->ClearRemoved();
+    for (std::vector<sOglOutputSource>::iterator it = sources.begin(); it != sources.end(); ++it) {
+        if (!(it->pending & backMask))
+            continue;
+        it->pending &= ~backMask;
+        it->fb->BindRead();
+        it->fb->Blit(it->x, it->y + it->fb->Height(), it->x + it->fb->Width(), it->y);
+    }
 #endif
     oFb->Unbind();
 
-    pVMed->ActivateOsd();
+    oFb->Present();
+    presented = true;
+    finished = oFb->Finish();
+    if (finished)
+        oFb->FrameDone(start);
     return true;
 }
 
@@ -1470,25 +3636,68 @@ bool cOglCmdDrawSlope::Execute(void) {
     return true;
 }
 
+//------------------ cOglCmdDrawPixels --------------------
+cOglCmdDrawPixels::cOglCmdDrawPixels(cOglFb *fb, std::vector<GLfloat> &vertices) : cOglCmd(fb) {
+    this->vertices.swap(vertices);
+}
+
+bool cOglCmdDrawPixels::Execute(void) {
+    //position and color per pixel
+    int count = vertices.size() / 6;
+
+    VertexBuffers[vbPixel]->ActivateShader();
+    VertexBuffers[vbPixel]->SetShaderProjectionMatrix(fb->Width(), fb->Height());
+
+    fb->Bind();
+    VertexBuffers[vbPixel]->DisableBlending();
+    VertexBuffers[vbPixel]->Bind();
+    VertexBuffers[vbPixel]->SetVertexData(&vertices[0], count);
+    VertexBuffers[vbPixel]->DrawArrays(count);
+    VertexBuffers[vbPixel]->Unbind();
+    VertexBuffers[vbPixel]->EnableBlending();
+    fb->Unbind();
+
+    return true;
+}
+
 //------------------ cOglCmdDrawText --------------------
-cOglCmdDrawText::cOglCmdDrawText( cOglFb *fb, GLint x, GLint y, unsigned int *symbols, GLint limitX, 
-                                  const char *name, int fontSize, tColor colorText) : cOglCmd(fb), fontName(name)  {
+cOglCmdDrawText::cOglCmdDrawText( cOglFb *fb, GLint x, GLint y, std::shared_ptr<sOglTextLayout> layout, GLint limitX, 
+                                  tColor colorText) : cOglCmd(fb) {
     this->x = x;
     this->y = y;
     this->limitX = limitX;
     this->colorText = colorText;
-    this->fontSize = fontSize;
-    this->symbols = symbols;
+    this->layout = layout;
 }
 
-cOglCmdDrawText::~cOglCmdDrawText(void) {
-    free(symbols);
+//looks up glyphs and kerning once, later draws of the same text reuse the positions
+void cOglCmdDrawText::Layout(cOglFont *font) {
+    cOglGlyph *prevGlyph = NULL;
+    int pen = 0;
+    layout->glyphs.clear();
+    for (int i = 0; layout->symbols[i]; i++) {
+        cOglGlyph *g = font->Glyph(layout->symbols[i]);
+        if (!g) {
+            esyslog("[openglosd]ERROR: could not load glyph %x", layout->symbols[i]);
+            continue;
+        }
+        sOglGlyphPos pos;
+        pos.glyph = g;
+        pos.pen = pen;
+        pos.kerning = font->Kerning(g, prevGlyph);
+        layout->glyphs.push_back(pos);
+        pen += pos.kerning + g->AdvanceX();
+        prevGlyph = g;
+    }
+    layout->laidOut = true;
 }
 
 bool cOglCmdDrawText::Execute(void) {
-    cOglFont *f = cOglFont::Get(*fontName, fontSize);
+    cOglFont *f = cOglFont::Get(layout->font);
     if (!f)
         return false;
+    if (!layout->laidOut)
+        Layout(f);
 
     VertexBuffers[vbText]->ActivateShader();
     VertexBuffers[vbText]->SetShaderColor(colorText);
@@ -1497,26 +3706,17 @@ bool cOglCmdDrawText::Execute(void) {
     fb->Bind();
     VertexBuffers[vbText]->Bind();
 
-    int xGlyph = x;
     int fontHeight = f->Height();
     int bottom = f->Bottom();
-    uint sym = 0;
-    uint prevSym = 0;
-    int kerning = 0;
 
-    for (int i = 0; symbols[i]; i++) {
-        sym = symbols[i];
-        cOglGlyph *g = f->Glyph(sym);
-        if (!g) {
-            esyslog("[openglosd]ERROR: could not load glyph %x", sym);
-        }
+    for (std::vector<sOglGlyphPos>::iterator it = layout->glyphs.begin(); it != layout->glyphs.end(); ++it) {
+        cOglGlyph *g = it->glyph;
+        int xGlyph = x + it->pen;
+        int kerning = it->kerning;
 
         if ( limitX && xGlyph + g->AdvanceX() > limitX )
             break;
 
-        kerning = f->Kerning(g, prevSym);
-        prevSym = sym;
-
         GLfloat x1 = xGlyph + kerning + g->BearingLeft();          //left
         GLfloat y1 = y + (fontHeight - bottom - g->BearingTop());  //top
         GLfloat x2 = x1 + g->Width();                              //right
@@ -1548,29 +3748,10 @@ bool cOglCmdDrawText::Execute(void) {
     return true;
 }
 
-//------------------ cOglCmdDrawImage --------------------
-cOglCmdDrawImage::cOglCmdDrawImage(cOglFb *fb, tColor *argb, GLint width, GLint height, GLint x, GLint y, bool overlay, double scaleX, double scaleY): cOglCmd(fb) {
-    this->argb = argb;
-    this->x = x;
-    this->y = y;
-    this->width = width;
-    this->height = height;
-    this->overlay = overlay;
-    this->scaleX = scaleX;
-    this->scaleY = scaleY;
-#ifdef USE_GLES2
-    this->bcolor = BORDERCOLOR;
-#endif
-}
-
-cOglCmdDrawImage::~cOglCmdDrawImage(void) {
-    free(argb);
-}
-
-bool cOglCmdDrawImage::Execute(void) {
-    GLuint texture;
-    GL_CHECK(glGenTextures(1, &texture));
-    GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
+//without argb, only the storage is allocated
+static void CreateImageTexture(GLuint *texture, const tColor *argb, GLint width, GLint height) {
+    GL_CHECK(glGenTextures(1, texture));
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, *texture));
     GL_CHECK(glTexImage2D(
         GL_TEXTURE_2D,
         0,
@@ -1582,20 +3763,72 @@ bool cOglCmdDrawImage::Execute(void) {
         width,
         height,
         0,
-#ifdef USE_GLES2
-        GL_RGBA,
-        GL_UNSIGNED_BYTE,
-#else
-        GL_BGRA,
-        GL_UNSIGNED_INT_8_8_8_8_REV,
-#endif
-        argb
+        OGL_IMAGE_FORMAT,
+        OGL_IMAGE_TYPE,
+        NULL
     ));
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    if (argb)
+        Uploader->Upload(width, 0, height, OGL_IMAGE_FORMAT, OGL_IMAGE_TYPE, argb, width * sizeof(tColor));
     GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+//------------------ cOglCmdDrawImage --------------------
+cOglCmdDrawImage::cOglCmdDrawImage(cOglFb *fb, std::shared_ptr<const tColor> argb, GLint width, GLint height, GLint x, GLint y, bool overlay, double scaleX, double scaleY): cOglCmd(fb) {
+    this->argb = argb;
+    this->x = x;
+    this->y = y;
+    this->width = width;
+    this->height = height;
+    this->overlay = overlay;
+    this->scaleX = scaleX;
+    this->scaleY = scaleY;
+    cache = NULL;
+    cacheKey = 0;
+    cachedTexture = GL_NONE;
+    texture = GL_NONE;
+    row = 0;
+#ifdef USE_GLES2
+    this->bcolor = BORDERCOLOR;
+#endif
+}
+
+cOglCmdDrawImage::cOglCmdDrawImage(cOglFb *fb, cOglTextureCache *cache, uint64_t cacheKey, GLuint cachedTexture, GLint width, GLint height, GLint x, GLint y): cOglCmd(fb) {
+    this->x = x;
+    this->y = y;
+    this->width = width;
+    this->height = height;
+    overlay = true;
+    scaleX = 1.0f;
+    scaleY = 1.0f;
+    this->cache = cache;
+    this->cacheKey = cacheKey;
+    this->cachedTexture = cachedTexture;
+    texture = GL_NONE;
+    row = 0;
+#ifdef USE_GLES2
+    this->bcolor = BORDERCOLOR;
+#endif
+}
+
+bool cOglCmdDrawImage::Execute(void) {
+    if (cachedTexture != GL_NONE)
+        texture = cachedTexture;
+    else if (texture == GL_NONE || row < height) {
+        //large images are uploaded in chunks, commands on other framebuffers run in between
+        if (texture == GL_NONE)
+            CreateImageTexture(&texture, NULL, width, height);
+        int rows = std::min(Uploader->ChunkRows(width * sizeof(tColor)), height - row);
+        GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
+        Uploader->Upload(width, row, rows, OGL_IMAGE_FORMAT, OGL_IMAGE_TYPE, argb.get() + row * width, width * sizeof(tColor));
+        GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+        row += rows;
+        if (row < height)
+            return true;
+    }
 
     GLfloat x1 = x;          //left
     GLfloat y1 = y;          //top
@@ -1631,11 +3864,169 @@ bool cOglCmdDrawImage::Execute(void) {
         VertexBuffers[vbTexture]->EnableBlending();
     fb->Unbind();
     GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
-    GL_CHECK(glDeleteTextures(1, &texture));
+    if (cachedTexture != GL_NONE)
+        cache->Release(cacheKey);
+    else if (!cache || !cache->Insert(cacheKey, texture, width, height))
+        GL_CHECK(glDeleteTextures(1, &texture));
+
+    return true;
+}
+
+//------------------ cOglCmdDrawBitmap --------------------
+cOglCmdDrawBitmap::cOglCmdDrawBitmap(cOglFb *fb, tIndex *indices, tColor *palette, GLint width, GLint height, GLint x, GLint y, bool overlay,
+                                     double scaleX, double scaleY, bool filter, sOglBitmapTextures *bitmapTextures) : cOglCmd(fb) {
+    this->indices = indices;
+    this->palette = palette;
+    this->x = x;
+    this->y = y;
+    this->width = width;
+    this->height = height;
+    this->overlay = overlay;
+    this->scaleX = scaleX;
+    this->scaleY = scaleY;
+    this->filter = filter;
+    this->bitmapTextures = bitmapTextures;
+}
+
+cOglCmdDrawBitmap::~cOglCmdDrawBitmap(void) {
+    free(indices);
+    free(palette);
+}
+
+bool cOglCmdDrawBitmap::Execute(void) {
+    GLuint localTextures[2];
+    GLuint *textures = localTextures;
+    bool allocate = true;
+    if (bitmapTextures) {
+        //persistent textures only get new content, unless the size changed
+        textures = bitmapTextures->textures;
+        if (textures[0] == GL_NONE)
+            GL_CHECK(glGenTextures(2, textures));
+        else
+            allocate = bitmapTextures->width != width || bitmapTextures->height != height;
+        bitmapTextures->width = width;
+        bitmapTextures->height = height;
+    } else
+        GL_CHECK(glGenTextures(2, textures));
+    //one byte per pixel, the palette lookup is done in the shader
+    GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, textures[0]));
+    if (allocate) {
+        GL_CHECK(glTexImage2D(
+            GL_TEXTURE_2D,
+            0,
+#ifdef USE_GLES2
+            GL_LUMINANCE,
+#else
+            GL_RED,
+#endif
+            width,
+            height,
+            0,
+#ifdef USE_GLES2
+            GL_LUMINANCE,
+#else
+            GL_RED,
+#endif
+            GL_UNSIGNED_BYTE,
+            indices
+        ));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    } else {
+#ifdef USE_GLES2
+        GL_CHECK(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_LUMINANCE, GL_UNSIGNED_BYTE, indices));
+#else
+        GL_CHECK(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, indices));
+#endif
+    }
+    GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, textures[1]));
+    if (allocate) {
+        GL_CHECK(glTexImage2D(
+            GL_TEXTURE_2D,
+            0,
+#ifdef USE_GLES2
+            GL_RGBA,
+#else
+            GL_RGBA8,
+#endif
+            MAXNUMCOLORS,
+            1,
+            0,
+            OGL_IMAGE_FORMAT,
+            OGL_IMAGE_TYPE,
+            palette
+        ));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    } else
+        GL_CHECK(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, MAXNUMCOLORS, 1, OGL_IMAGE_FORMAT, OGL_IMAGE_TYPE, palette));
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+
+    //scaling is done by the quad size, the shader samples the index texture accordingly
+    GLfloat x1 = x;                    //left
+    GLfloat y1 = y;                    //top
+    GLfloat x2 = x + width * scaleX;   //right
+    GLfloat y2 = y + height * scaleY;  //bottom
+
+    GLfloat quadVertices[] = {
+        x1, y2,   0.0, 1.0,     // left bottom
+        x1, y1,   0.0, 0.0,     // left top
+        x2, y1,   1.0, 0.0,     // right top
+
+        x1, y2,   0.0, 1.0,     // left bottom
+        x2, y1,   1.0, 0.0,     // right top
+        x2, y2,   1.0, 1.0      // right bottom     
+    };
+
+    VertexBuffers[vbPalette]->ActivateShader();
+    VertexBuffers[vbPalette]->SetShaderPalette(overlay, filter, width, height);
+    VertexBuffers[vbPalette]->SetShaderProjectionMatrix(fb->Width(), fb->Height());
+
+    fb->Bind();
+    GL_CHECK(glActiveTexture(GL_TEXTURE1));
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, textures[1]));
+    GL_CHECK(glActiveTexture(GL_TEXTURE0));
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, textures[0]));
+    if (overlay)
+        VertexBuffers[vbPalette]->DisableBlending();
+    VertexBuffers[vbPalette]->Bind();
+    VertexBuffers[vbPalette]->SetVertexData(quadVertices);
+    VertexBuffers[vbPalette]->DrawArrays();
+    VertexBuffers[vbPalette]->Unbind();
+    if (overlay)
+        VertexBuffers[vbPalette]->EnableBlending();
+    fb->Unbind();
+    GL_CHECK(glActiveTexture(GL_TEXTURE1));
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+    GL_CHECK(glActiveTexture(GL_TEXTURE0));
+    if (!bitmapTextures)
+        GL_CHECK(glDeleteTextures(2, textures));
+
+    return true;
+}
 
+//------------------ cOglCmdDeleteBitmapTextures --------------------
+cOglCmdDeleteBitmapTextures::cOglCmdDeleteBitmapTextures(std::vector<sOglBitmapTextures *> &bitmapTextures) : cOglCmd(NULL) {
+    this->bitmapTextures.swap(bitmapTextures);
+}
+
+bool cOglCmdDeleteBitmapTextures::Execute(void) {
+    for (size_t i = 0; i < bitmapTextures.size(); i++) {
+        if (bitmapTextures[i]->textures[0] != GL_NONE)
+            GL_CHECK(glDeleteTextures(2, bitmapTextures[i]->textures));
+        delete bitmapTextures[i];
+    }
     return true;
 }
 
+
 //------------------ cOglCmdDrawTexture --------------------
 cOglCmdDrawTexture::cOglCmdDrawTexture(cOglFb *fb, sOglImage *imageRef, GLint x, GLint y): cOglCmd(fb) {
     this->imageRef = imageRef;
@@ -1647,6 +4038,26 @@ cOglCmdDrawTexture::cOglCmdDrawTexture(cOglFb *fb, sOglImage *imageRef, GLint x,
 }
 
 bool cOglCmdDrawTexture::Execute(void) {
+    //re-upload an evicted image
+    if (imageRef->texture == GL_NONE) {
+        if (imageRef->etc1) {
+#ifdef USE_GLES2
+            GL_CHECK(glGenTextures(1, &imageRef->texture));
+            GL_CHECK(glBindTexture(GL_TEXTURE_2D, imageRef->texture));
+            GL_CHECK(glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_ETC1_RGB8_OES, imageRef->width, imageRef->height, 0, imageRef->memSize, imageRef->etc1));
+            GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+            GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+            GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+            GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+            GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+#endif
+        } else if (imageRef->backup) {
+            CreateImageTexture(&imageRef->texture, imageRef->backup, imageRef->width, imageRef->height);
+            free(imageRef->backup);
+            imageRef->backup = NULL;
+        } else
+            return false;
+    }
     GLfloat x1 = x;                    //top
     GLfloat y1 = y;                    //left
     GLfloat x2 = x + imageRef->width;  //right
@@ -1683,43 +4094,113 @@ bool cOglCmdDrawTexture::Execute(void) {
 
 
 //------------------ cOglCmdStoreImage --------------------
-cOglCmdStoreImage::cOglCmdStoreImage(sOglImage *imageRef, tColor *argb) : cOglCmd(NULL) {
+cOglCmdStoreImage::cOglCmdStoreImage(sOglImage *imageRef, const tColor *argb, cCondWait *wait) : cOglCmd(NULL) {
     this->imageRef = imageRef;
-    data = argb;    
-}
-
-cOglCmdStoreImage::~cOglCmdStoreImage(void) {
-    free(data);
+    data = argb;
+    this->wait = wait;
+    row = 0;
 }
 
 bool cOglCmdStoreImage::Execute(void) {
-    GL_CHECK(glGenTextures(1, &imageRef->texture));
+    if (row == 0) {
+        CreateImageTexture(&imageRef->texture, NULL, imageRef->width, imageRef->height);
+        imageRef->uploading = true;
+    }
+    //large images are uploaded in chunks, other commands run in between
+    int rows = std::min(Uploader->ChunkRows(imageRef->width * sizeof(tColor)), imageRef->height - row);
     GL_CHECK(glBindTexture(GL_TEXTURE_2D, imageRef->texture));
-    GL_CHECK(glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
+    Uploader->Upload(imageRef->width, row, rows, OGL_IMAGE_FORMAT, OGL_IMAGE_TYPE, data + row * imageRef->width, imageRef->width * sizeof(tColor));
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+    row += rows;
+    if (row >= imageRef->height) {
+        imageRef->uploading = false;
+        //data belongs to the caller, which is waiting for us
+        wait->Signal();
+    }
+    return true;
+}
+
+//------------------ cOglCmdEvictImage --------------------
+cOglCmdEvictImage::cOglCmdEvictImage(sOglImage *imageRef, tColor *backup) : cOglCmd(NULL) {
+    this->imageRef = imageRef;
+    this->backup = backup;
+    deferred = false;
+}
+
+bool cOglCmdEvictImage::Execute(void) {
+    deferred = imageRef->uploading;
+    if (deferred)
+        return true;
+    if (imageRef->texture == GL_NONE || imageRef->backup)
+        return true;
+    //compressed textures can not be read back, but their data is still around
+    if (imageRef->etc1) {
+        GL_CHECK(glDeleteTextures(1, &imageRef->texture));
+        imageRef->texture = GL_NONE;
+        return true;
+    }
+    if (!backup)
+        return false;
+    imageRef->backup = backup;
+    backup = NULL;
+    //read the texture back through a temporary framebuffer, GLES has no glGetTexImage
+    GLuint fb;
+    GL_CHECK(glGenFramebuffers(1, &fb));
+    GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, fb));
+    GL_CHECK(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, imageRef->texture, 0));
 #ifdef USE_GLES2
-        GL_RGBA,
+    GL_CHECK(glReadPixels(0, 0, imageRef->width, imageRef->height, GL_RGBA, GL_UNSIGNED_BYTE, imageRef->backup));
 #else
-        GL_RGBA8,
+    GL_CHECK(glReadPixels(0, 0, imageRef->width, imageRef->height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, imageRef->backup));
 #endif
-        imageRef->width,
-        imageRef->height,
-        0,
-#ifdef USE_GLES2
-        GL_RGBA,
-        GL_UNSIGNED_BYTE,
-#else
-        GL_BGRA,
-        GL_UNSIGNED_INT_8_8_8_8_REV,
+    GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    GL_CHECK(glDeleteFramebuffers(1, &fb));
+    GL_CHECK(glDeleteTextures(1, &imageRef->texture));
+    imageRef->texture = GL_NONE;
+    return true;
+}
+
+//------------------ cOglCmdReplaceImage --------------------
+cOglCmdReplaceImage::cOglCmdReplaceImage(sOglImage *imageRef, const sOglEncodedImage &image) : cOglCmd(NULL) {
+    this->imageRef = imageRef;
+    this->image = image;
+}
+
+cOglCmdReplaceImage::~cOglCmdReplaceImage(void) {
+    free(image.data);
+}
+
+bool cOglCmdReplaceImage::Execute(void) {
+#ifdef OSD_DEBUG
+    uint64_t start = cTimeMs::Now();
 #endif
-        data
-    ));
+    GLuint texture;
+    GL_CHECK(glGenTextures(1, &texture));
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
+    if (image.compressed) {
+        GL_CHECK(glCompressedTexImage2D(GL_TEXTURE_2D, 0, image.internalFormat, imageRef->width, imageRef->height, 0, image.size, image.data));
+    } else {
+        //rows of 16 bit texels are not necessarily 4 byte aligned
+        GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 2));
+        GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, image.internalFormat, imageRef->width, imageRef->height, 0, image.format, image.type, NULL));
+        Uploader->Upload(imageRef->width, 0, imageRef->height, image.format, image.type, image.data, imageRef->width * sizeof(uint16_t));
+        GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+    }
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
     GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+    if (imageRef->texture != GL_NONE)
+        GL_CHECK(glDeleteTextures(1, &imageRef->texture));
+    imageRef->texture = texture;
+    if (image.compressed) {
+        imageRef->etc1 = image.data;
+        image.data = NULL;
+    }
+#ifdef OSD_DEBUG
+    dsyslog("[openglosd]replaced %dx%d image texture in %dms", imageRef->width, imageRef->height, (int)(cTimeMs::Now() - start));
+#endif
     return true;
 }
 
@@ -1727,31 +4208,310 @@ bool cOglCmdStoreImage::Execute(void) {
 cOglCmdDropImage::cOglCmdDropImage(sOglImage *imageRef, cCondWait *wait) : cOglCmd(NULL) {
     this->imageRef = imageRef;
     this->wait = wait;
+    deferred = false;
 }
 
 bool cOglCmdDropImage::Execute(void) {
+    //wait until a store command still uploading is done with the image data
+    deferred = imageRef->uploading;
+    if (deferred)
+        return true;
     if (imageRef->texture != GL_NONE)
         GL_CHECK(glDeleteTextures(1, &imageRef->texture));
+    free(imageRef->backup);
+    imageRef->backup = NULL;
+    free(imageRef->etc1);
+    imageRef->etc1 = NULL;
     wait->Signal();
     return true;
 }
 
+/******************************************************************************
+* cOglImageEncoder
+******************************************************************************/
+static const int etc1Modifiers[8][2] = {
+    {  2,   8 }, {  5,  17 }, {  9,  29 }, { 13,  42 },
+    { 18,  60 }, { 24,  80 }, { 33, 106 }, { 47, 183 }
+};
+
+//channels in the order the texture holds them, GLES textures get uploaded with swapped red and blue
+static inline void TexelChannels(tColor color, int &r, int &g, int &b, int &a) {
+    a = (color >> 24) & 0xFF;
+    g = (color >> 8) & 0xFF;
+#ifdef USE_GLES2
+    r = color & 0xFF;
+    b = (color >> 16) & 0xFF;
+#else
+    r = (color >> 16) & 0xFF;
+    b = color & 0xFF;
+#endif
+}
+
+//squared error of the best modifier, idx returns its pixel index
+static inline int Etc1PixelError(const int *pixel, const int *base, int table, int &idx) {
+    static const int sign[4] = { 1, 1, -1, -1 };
+    int best = INT_MAX;
+    for (int i = 0; i < 4; i++) {
+        int mod = sign[i] * etc1Modifiers[table][i & 1];
+        int error = 0;
+        for (int c = 0; c < 3; c++) {
+            int d = constrain(base[c] + mod, 0, 255) - pixel[c];
+            error += d * d;
+        }
+        if (error < best) {
+            best = error;
+            idx = i;
+        }
+    }
+    return best;
+}
+
+//block holds 16 pixels in rows, encodes both orientations and keeps the better one
+static uint64_t EncodeEtc1Block(const int block[16][3]) {
+    uint64_t best = 0;
+    long bestError = LONG_MAX;
+    for (int flip = 0; flip < 2; flip++) {
+        int sum[2][3] = { { 0, 0, 0 }, { 0, 0, 0 } };
+        for (int p = 0; p < 16; p++) {
+            int sub = flip ? p / 8 : (p % 4) / 2;
+            for (int c = 0; c < 3; c++)
+                sum[sub][c] += block[p][c];
+        }
+        int q[2][3], base[2][3];
+        bool diff = true;
+        for (int sub = 0; sub < 2; sub++)
+            for (int c = 0; c < 3; c++)
+                q[sub][c] = (sum[sub][c] * 31 + 4 * 255) / (8 * 255);
+        for (int c = 0; c < 3; c++)
+            if (q[1][c] - q[0][c] < -4 || q[1][c] - q[0][c] > 3)
+                diff = false;
+        for (int sub = 0; sub < 2; sub++)
+            for (int c = 0; c < 3; c++) {
+                if (diff) {
+                    base[sub][c] = (q[sub][c] << 3) | (q[sub][c] >> 2);
+                } else {
+                    q[sub][c] = (sum[sub][c] * 15 + 4 * 255) / (8 * 255);
+                    base[sub][c] = (q[sub][c] << 4) | q[sub][c];
+                }
+            }
+        int table[2] = { 0, 0 };
+        long error = 0;
+        for (int sub = 0; sub < 2; sub++) {
+            long subBest = LONG_MAX;
+            for (int t = 0; t < 8; t++) {
+                long subError = 0;
+                int idx;
+                for (int p = 0; p < 16; p++)
+                    if ((flip ? p / 8 : (p % 4) / 2) == sub)
+                        subError += Etc1PixelError(block[p], base[sub], t, idx);
+                if (subError < subBest) {
+                    subBest = subError;
+                    table[sub] = t;
+                }
+            }
+            error += subBest;
+        }
+        if (error >= bestError)
+            continue;
+        bestError = error;
+        //pixel indices are numbered column by column
+        uint32_t msb = 0, lsb = 0;
+        for (int p = 0; p < 16; p++) {
+            int sub = flip ? p / 8 : (p % 4) / 2;
+            int idx = 0;
+            Etc1PixelError(block[p], base[sub], table[sub], idx);
+            int bit = (p % 4) * 4 + p / 4;
+            msb |= (idx >> 1) << bit;
+            lsb |= (idx & 1) << bit;
+        }
+        uint32_t high;
+        if (diff)
+            high = ((uint32_t)q[0][0] << 27) | (((q[1][0] - q[0][0]) & 7) << 24) |
+                   (q[0][1] << 19) | (((q[1][1] - q[0][1]) & 7) << 16) |
+                   (q[0][2] << 11) | (((q[1][2] - q[0][2]) & 7) << 8) | 2;
+        else
+            high = ((uint32_t)q[0][0] << 28) | (q[1][0] << 24) |
+                   (q[0][1] << 20) | (q[1][1] << 16) |
+                   (q[0][2] << 12) | (q[1][2] << 8);
+        high |= (table[0] << 5) | (table[1] << 2) | flip;
+        best = ((uint64_t)high << 32) | (msb << 16) | lsb;
+    }
+    return best;
+}
+
+static void EncodeEtc1(const tColor *argb, int width, int height, GLubyte *out) {
+    int block[16][3];
+    int a;
+    for (int by = 0; by < height; by += 4) {
+        for (int bx = 0; bx < width; bx += 4) {
+            //pad partial blocks by repeating the last row and column
+            for (int p = 0; p < 16; p++) {
+                int x = std::min(bx + p % 4, width - 1);
+                int y = std::min(by + p / 4, height - 1);
+                TexelChannels(argb[y * width + x], block[p][0], block[p][1], block[p][2], a);
+            }
+            uint64_t word = EncodeEtc1Block(block);
+            for (int i = 0; i < 8; i++)
+                *out++ = word >> (56 - 8 * i);
+        }
+    }
+}
+
+cOglImageEncoder::cOglImageEncoder(cOglThread *oglThread, int storage) : cThread("oglImageEncoder") {
+    this->oglThread = oglThread;
+    this->storage = storage;
+    Start();
+}
+
+cOglImageEncoder::~cOglImageEncoder(void) {
+    Cancel(-1);
+    wait.Signal();
+    Cancel(3);
+    while (!jobs.empty()) {
+        free(jobs.front().argb);
+        jobs.pop();
+    }
+}
+
+void cOglImageEncoder::Add(int slot, int serial, tColor *argb, int width, int height) {
+    sOglEncodeJob job;
+    job.slot = slot;
+    job.serial = serial;
+    job.argb = argb;
+    job.width = width;
+    job.height = height;
+    Lock();
+    jobs.push(job);
+    Unlock();
+    wait.Signal();
+}
+
+void cOglImageEncoder::Action(void) {
+    while (Running()) {
+        Lock();
+        bool empty = jobs.empty();
+        sOglEncodeJob job;
+        if (!empty) {
+            job = jobs.front();
+            jobs.pop();
+        }
+        Unlock();
+        if (empty) {
+            wait.Wait(100);
+            continue;
+        }
+        Encode(job);
+        free(job.argb);
+    }
+}
+
+void cOglImageEncoder::Encode(const sOglEncodeJob &job) {
+    uint64_t start = cTimeMs::Now();
+    int count = job.width * job.height;
+    bool opaque = true, rgb565 = true, rgba4444 = true;
+    int r, g, b, a;
+    for (int i = 0; i < count && (opaque || rgb565 || rgba4444); i++) {
+        TexelChannels(job.argb[i], r, g, b, a);
+        if (a != 0xFF)
+            opaque = false;
+        //GL expands the channels by bit replication, 31 becomes 255
+        if (r != ((r >> 3) << 3 | r >> 5) || g != ((g >> 2) << 2 | g >> 6) || b != ((b >> 3) << 3 | b >> 5))
+            rgb565 = false;
+        if (r != (r >> 4) * 0x11 || g != (g >> 4) * 0x11 || b != (b >> 4) * 0x11 || a != (a >> 4) * 0x11)
+            rgba4444 = false;
+    }
+
+    sOglEncodedImage image;
+    image.compressed = false;
+    const char *name;
+    if ((storage & isReducedDepth) && opaque && rgb565) {
+        uint16_t *texels = MALLOC(uint16_t, count);
+        if (!texels)
+            return;
+        for (int i = 0; i < count; i++) {
+            TexelChannels(job.argb[i], r, g, b, a);
+            texels[i] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+        }
+#ifdef USE_GLES2
+        image.internalFormat = GL_RGB;
+#else
+        image.internalFormat = GL_RGB565;
+#endif
+        image.format = GL_RGB;
+        image.type = GL_UNSIGNED_SHORT_5_6_5;
+        image.data = (GLubyte *)texels;
+        image.size = count * sizeof(uint16_t);
+        name = "RGB565";
+    } else if ((storage & isReducedDepth) && rgba4444) {
+        uint16_t *texels = MALLOC(uint16_t, count);
+        if (!texels)
+            return;
+        for (int i = 0; i < count; i++) {
+            TexelChannels(job.argb[i], r, g, b, a);
+            texels[i] = ((r >> 4) << 12) | ((g >> 4) << 8) | ((b >> 4) << 4) | (a >> 4);
+        }
+#ifdef USE_GLES2
+        image.internalFormat = GL_RGBA;
+#else
+        image.internalFormat = GL_RGBA4;
+#endif
+        image.format = GL_RGBA;
+        image.type = GL_UNSIGNED_SHORT_4_4_4_4;
+        image.data = (GLubyte *)texels;
+        image.size = count * sizeof(uint16_t);
+        name = "RGBA4444";
+#ifdef USE_GLES2
+    } else if ((storage & isEtc1) && oglThread->Etc1Support() && opaque) {
+        image.size = ((job.width + 3) / 4) * ((job.height + 3) / 4) * 8;
+        image.data = MALLOC(GLubyte, image.size);
+        if (!image.data)
+            return;
+        EncodeEtc1(job.argb, job.width, job.height, image.data);
+        image.internalFormat = GL_ETC1_RGB8_OES;
+        image.format = GL_RGB;
+        image.type = GL_UNSIGNED_BYTE;
+        image.compressed = true;
+        name = "ETC1";
+#endif
+    } else
+        return;
+
+#ifdef OSD_DEBUG
+    dsyslog("[openglosd]stored %dx%d image as %s, %ldkb saved, encoding took %dms", job.width, job.height, name,
+            (count * (long)sizeof(tColor) - image.size) / 1024, (int)(cTimeMs::Now() - start));
+#else
+    (void)name;
+    (void)start;
+#endif
+    oglThread->ReplaceImage(job.slot, job.serial, image);
+}
+
 /******************************************************************************
 * cOglThread
 ******************************************************************************/
-cOglThread::cOglThread(cCondWait *startWait, int maxCacheSize) : cThread("oglThread") {
+cOglThread::cOglThread(cCondWait *startWait, int maxCacheSize, int maxFbMemSize, int imageStorage, int outputBackend) : cThread("oglThread") {
     stalled = false;
     memCached = 0;
     this->maxCacheSize = maxCacheSize * 1024 * 1024;
+    this->maxFbMemSize = (long)maxFbMemSize * 1024 * 1024;
     this->startWait = startWait;
     wait = new cCondWait();
     maxTextureSize = 0;
-    for (int i = 0; i < OGL_MAX_OSDIMAGES; i++) {
-        imageCache[i].used = false;
-        imageCache[i].texture = GL_NONE;        
-        imageCache[i].width = 0;
-        imageCache[i].height = 0;
-    }
+    paletteShader = false;
+    textureCache = new cOglTextureCache(OGL_TEXCACHE_MAX_SIZE * 1024 * 1024);
+    textLayouts = new cOglTextLayoutCache();
+    imageTick = 0;
+    imageHits = 0;
+    imageEvictions = 0;
+    imageReuploads = 0;
+    this->imageStorage = imageStorage;
+    etc1Support = false;
+    imageEncoder = imageStorage ? new cOglImageEncoder(this, imageStorage) : NULL;
+    imagesEncoded = 0;
+    imageMemSaved = 0;
+    this->outputBackend = outputBackend;
+    cOglFont::SetFaceLoader(cOglFaceLoader::Instance());
+    InitPrewarm();
 
     Start();
 }
@@ -1759,14 +4519,29 @@ cOglThread::cOglThread(cCondWait *startWait, int maxCacheSize) : cThread("oglThr
 cOglThread::~cOglThread() {
     delete wait;
     wait = NULL;
+    delete textureCache;
+    textureCache = NULL;
+    delete textLayouts;
+    textLayouts = NULL;
+    //Stop() is not called if the thread failed to start
+    delete imageEncoder;
+    imageEncoder = NULL;
+    cOglFont::SetFaceLoader(NULL);
 }
 
 void cOglThread::Stop(void) {
-    for (int i = 0; i < OGL_MAX_OSDIMAGES; i++) {
+    delete imageEncoder;
+    imageEncoder = NULL;
+    for (int i = 0; i < (int)imageCache.size(); i++) {
         if (imageCache[i].used) {
-            DropImageData(i);
+            DropImageData(-i - 1);
         }
     }
+    dsyslog("[openglosd]image cache: %d slots, %d hits, %d evictions, %d re-uploads",
+            (int)imageCache.size(), imageHits, imageEvictions, imageReuploads);
+    if (imageStorage)
+        dsyslog("[openglosd]image storage: %d images stored in reduced formats, %.2fMB saved",
+                imagesEncoded, imageMemSaved / 1024.0f / 1024.0f);
     Cancel(2);
     stalled = false;
 }
@@ -1800,86 +4575,181 @@ int cOglThread::StoreImage(const cImage &image) {
         return 0;
     }
 
-    int imgSize = image.Width() * image.Height();
-    int newMemUsed = imgSize * sizeof(tColor) + memCached;
-    if (newMemUsed > maxCacheSize) {
-        float cachedMB = memCached / 1024.0f / 1024.0f;
-        float maxMB = maxCacheSize / 1024.0f / 1024.0f;
-        esyslog("[openglosd]Maximum size for GPU cache reached. Used: %.2fMB Max: %.2fMB", cachedMB, maxMB);
+    long imgSize = image.Width() * image.Height() * sizeof(tColor);
+    if (imgSize > maxCacheSize) {
+        esyslog("[openglosd]image of %.2fMB exceeds the GPU cache size of %.2fMB", imgSize / 1024.0f / 1024.0f, maxCacheSize / 1024.0f / 1024.0f);
         return 0;
     }
-    
-    int slot = GetFreeSlot();
-    if (!slot)
-        return 0;
-
-    tColor *argb = MALLOC(tColor, imgSize);
-    if (!argb) {
-        esyslog("[openglosd]memory allocation of %d kb for OSD image failed", imgSize  * sizeof(tColor) / 1024);
-        ClearSlot(slot);
-        slot = 0;
+    //make room by evicting the least recently drawn images
+    if (!EvictImages(imgSize))
         return 0;
-    }
-
-    memcpy(argb, image.Data(), sizeof(tColor) * imgSize);
 
+    int slot = GetFreeSlot(image.Width(), image.Height());
     sOglImage *imageRef = GetImageRef(slot);
-    imageRef->width = image.Width();
-    imageRef->height = image.Height();
-    DoCmd(new cOglCmdStoreImage(imageRef, argb));
-
-    cTimeMs timer(5000);
-    while (imageRef->used && imageRef->texture == 0 && !timer.TimedOut())
-        cCondWait::SleepMs(2);
+    //we wait for the upload anyway, so the GL thread reads directly from image
+    cCondWait storeWait;
+    DoCmd(new cOglCmdStoreImage(imageRef, image.Data(), &storeWait));
+    bool timedOut = !storeWait.Wait(5000);
 
     if (imageRef->texture == GL_NONE) {
-        esyslog("[openglosd]failed to store OSD image texture! (%s)", timer.TimedOut() ? "timed out" : "allocation failed");
+        esyslog("[openglosd]failed to store OSD image texture! (%s)", timedOut ? "timed out" : "allocation failed");
+        //commands are executed in order, so after the drop image and storeWait are not referenced anymore
         DropImageData(slot);
-        slot = 0;
+        return 0;
+    }
+
+    //find a smaller format in the background, the image data has to be copied for that
+    if (imageEncoder) {
+        tColor *argb = MALLOC(tColor, image.Width() * image.Height());
+        if (argb) {
+            memcpy(argb, image.Data(), imgSize);
+            imageEncoder->Add(slot, imageRef->serial, argb, image.Width(), image.Height());
+        }
     }
 
-    memCached += imgSize  * sizeof(tColor);
     return slot;
 }
 
-int cOglThread::GetFreeSlot(void) {
-    Lock();
-    int slot = 0;
-    for (int i = 0; i < OGL_MAX_OSDIMAGES && !slot; i++) {
-        if (!imageCache[i].used) {
-            imageCache[i].used = true;
-            slot = -i - 1;
-        }
+int cOglThread::GetFreeSlot(int width, int height) {
+    cMutexLock lock(&imageMutex);
+    int i;
+    if (!freeSlots.empty()) {
+        i = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        //a deque keeps references to the existing slots valid
+        i = imageCache.size();
+        imageCache.push_back(sOglImage());
     }
-    Unlock();
-    return slot;
+    sOglImage &image = imageCache[i];
+    image.texture = GL_NONE;
+    image.width = width;
+    image.height = height;
+    image.used = true;
+    image.evicted = false;
+    image.uploading = false;
+    image.backup = NULL;
+    image.etc1 = NULL;
+    image.compressed = false;
+    image.lastUsed = ++imageTick;
+    image.memSize = width * height * sizeof(tColor);
+    image.serial++;
+    return -i - 1;
 }
 
 void cOglThread::ClearSlot(int slot) {
     int i = -slot - 1;
-    if (i >= 0 && i < OGL_MAX_OSDIMAGES) {
-        Lock();
-        imageCache[i].used = false;    
+    cMutexLock lock(&imageMutex);
+    if (i >= 0 && i < (int)imageCache.size() && imageCache[i].used) {
+        imageCache[i].used = false;
         imageCache[i].texture = GL_NONE;
         imageCache[i].width = 0;
         imageCache[i].height = 0;
-        Unlock();
+        freeSlots.push_back(i);
+    }
+}
+
+bool cOglThread::EvictImages(long needed) {
+    std::vector<sOglImage *> victims;
+    std::vector<tColor *> backups;
+    bool fits = true;
+    imageMutex.Lock();
+    while (memCached + needed > maxCacheSize) {
+        sOglImage *oldest = NULL;
+        for (std::deque<sOglImage>::iterator it = imageCache.begin(); it != imageCache.end(); ++it)
+            if (it->used && !it->evicted && (!oldest || it->lastUsed < oldest->lastUsed))
+                oldest = &*it;
+        if (!oldest) {
+            fits = false;
+            break;
+        }
+        //the texture is read back into memory allocated here, so a failure can not break the accounting
+        tColor *backup = NULL;
+        if (!oldest->compressed) {
+            backup = MALLOC(tColor, oldest->width * oldest->height);
+            if (!backup) {
+                fits = false;
+                break;
+            }
+        }
+        backups.push_back(backup);
+        oldest->evicted = true;
+        memCached -= oldest->memSize;
+        imageEvictions++;
+        victims.push_back(oldest);
     }
+    if (fits)
+        memCached += needed;
+    imageMutex.Unlock();
+    //commands run in order, so draws queued before still see the texture
+    for (size_t i = 0; i < victims.size(); i++)
+        DoCmd(new cOglCmdEvictImage(victims[i], backups[i]));
+    return fits;
 }
 
 sOglImage *cOglThread::GetImageRef(int slot) {
     int i = -slot - 1;
-    if (0 <= i && i < OGL_MAX_OSDIMAGES)
+    cMutexLock lock(&imageMutex);
+    if (0 <= i && i < (int)imageCache.size())
         return &imageCache[i];
     return 0;
 }
 
+sOglImage *cOglThread::UseImage(int imageHandle) {
+    sOglImage *imageRef = GetImageRef(imageHandle);
+    if (!imageRef || !imageRef->used)
+        return NULL;
+    long size = 0;
+    imageMutex.Lock();
+    imageHits++;
+    imageRef->lastUsed = ++imageTick;
+    if (imageRef->evicted) {
+        //the draw command uploads the backup again, which is always RGBA
+        imageRef->evicted = false;
+        if (!imageRef->compressed)
+            imageRef->memSize = imageRef->width * imageRef->height * sizeof(tColor);
+        size = imageRef->memSize;
+        imageReuploads++;
+    }
+    imageMutex.Unlock();
+    //being the most recently used, this image is evicted last
+    if (size && !EvictImages(size)) {
+        //the draw command uploads the texture anyway, so it is accounted for over budget
+        cMutexLock lock(&imageMutex);
+        memCached += size;
+    }
+    return imageRef;
+}
+
+void cOglThread::ReplaceImage(int slot, int serial, const sOglEncodedImage &image) {
+    sOglImage *imageRef = GetImageRef(slot);
+    bool valid = false;
+    imageMutex.Lock();
+    if (imageRef && imageRef->used && imageRef->serial == serial && !imageRef->evicted) {
+        valid = true;
+        memCached -= imageRef->memSize - image.size;
+        imageMemSaved += imageRef->memSize - image.size;
+        imageRef->memSize = image.size;
+        imageRef->compressed = image.compressed;
+        imagesEncoded++;
+    }
+    imageMutex.Unlock();
+    if (valid)
+        DoCmd(new cOglCmdReplaceImage(imageRef, image));
+    else
+        free(image.data);
+}
+
 void cOglThread::DropImageData(int imageHandle) {
     sOglImage *imageRef = GetImageRef(imageHandle);
-    if (!imageRef)
+    if (!imageRef || !imageRef->used)
         return;
-    int imgSize = imageRef->width * imageRef->height * sizeof(tColor);
-    memCached -= imgSize;
+    imageMutex.Lock();
+    if (!imageRef->evicted)
+        memCached -= imageRef->memSize;
+    //pending encodings of this image are discarded
+    imageRef->serial++;
+    imageMutex.Unlock();
     cCondWait dropWait;
     DoCmd(new cOglCmdDropImage(imageRef, &dropWait));
     dropWait.Wait();
@@ -1888,6 +4758,7 @@ void cOglThread::DropImageData(int imageHandle) {
 
 
 void cOglThread::Action(void) {
+    uint64_t start = cTimeMs::Now();
     if (!InitOpenGL()) {
         esyslog("[openglosd]Could not initiate OpenGL Context");
         Cleanup();
@@ -1904,13 +4775,12 @@ void cOglThread::Action(void) {
     }
     dsyslog("[openglosd]Shaders initialized");
 
-    if (!InitVdpauInterop()) {
-        esyslog("[openglosd]: vdpau interop NOT initialized");
+    if (!InitOutput()) {
+        esyslog("[openglosd]: output NOT initialized");
         Cleanup();
         startWait->Signal();
         return;
     }
-    dsyslog("[openglosd]vdpau interop initialized");
 
     if (!InitVertexBuffers()) {
         esyslog("[openglosd]: Vertex Buffers NOT initialized");
@@ -1923,24 +4793,75 @@ void cOglThread::Action(void) {
     GL_CHECK(glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize));
     dsyslog("[openglosd]Maximum Pixmap size: %dx%dpx", maxTextureSize, maxTextureSize);
 
+    FbPool = new cOglFbPool(OGL_FBPOOL_MAX_SIZE * 1024 * 1024, OGL_FBPOOL_MAX_AGE);
+    FbMemory = new cOglFbMemory(maxFbMemSize);
+    Uploader = new cOglUploader();
+    if (pVMed->MaxSizeGPUGlyphMemory() > 0)
+        cOglGlyph::SetMemoryBudget((long)pVMed->MaxSizeGPUGlyphMemory() * 1024 * 1024);
+
     //now Thread is ready to do his job
+    dsyslog("[openglosd]OpenGL thread started in %dms", (int)(cTimeMs::Now() - start));
     startWait->Signal();
     stalled = false;
 
+#ifdef OSD_DEBUG
+    int maxLatency = 0;
+#endif
     while(Running()) {
 
-        if (commands.empty()) {
+        if (commands.empty() && held.empty()) {
+            FbPool->Trim();
+            FbMemory->Enforce();
+            //rasterize glyphs ahead of the first menu while there is nothing to draw
+            if (PrewarmGlyphs())
+                continue;
             wait->Wait(20);
             continue;
         }
 
-        Lock();
-        cOglCmd* cmd = commands.front();
-        commands.pop();
-        Unlock();
-        //uint64_t start = cTimeMs::Now();
+        cOglCmd* cmd;
+        if (ordered.empty() && !held.empty()) {
+            cmd = held.front();
+            held.pop_front();
+        } else {
+            Lock();
+            cmd = commands.front();
+            commands.pop();
+            Unlock();
+            if (!ordered.count(cmd) && Blocked(cmd)) {
+                Hold(cmd);
+                continue;
+            }
+        }
+#ifdef OSD_DEBUG
+        uint64_t start = cTimeMs::Now();
+#endif
         cmd->Execute();
+        //evict framebuffers between commands, when none of them is bound
+        FbMemory->Enforce();
+#ifdef OSD_DEBUG
+        int latency = cTimeMs::Now() - start;
+        if (latency > maxLatency) {
+            maxLatency = latency;
+            dsyslog("[openglosd]worst command latency so far: \"%s\" %dms", cmd->Description(), latency);
+        }
+#endif
         //esyslog("[openglosd]\"%s\", %dms, %d commands left, time %" PRIu64 "", cmd->Description(), (int)(cTimeMs::Now() - start), commands.size(), cTimeMs::Now());
+        if (cmd->Pending()) {
+            if (cmd->Ordered() && ordered.insert(cmd).second) {
+                blockedFbs.insert(cmd->Fb());
+                if (cmd->SecondFb())
+                    blockedFbs.insert(cmd->SecondFb());
+            }
+            //continue after the commands queued meanwhile
+            Lock();
+            commands.push(cmd);
+            Unlock();
+            continue;
+        }
+        ordered.erase(cmd);
+        if (ordered.empty() && held.empty())
+            blockedFbs.clear();
         delete cmd;
         if (stalled && commands.size() < OGL_CMDQUEUE_SIZE / 2)
             stalled = false;
@@ -1951,6 +4872,99 @@ void cOglThread::Action(void) {
     dsyslog("[openglosd]OpenGL Worker Thread Ended");
 }
 
+//commands on framebuffers of pending ordered commands, or of commands already held, keep their order,
+//commands without a framebuffer may refer to anything drawn before and wait for all held ones
+bool cOglThread::Blocked(cOglCmd *cmd) {
+    if (blockedFbs.empty())
+        return false;
+    if (!cmd->Fb())
+        return !held.empty();
+    return blockedFbs.count(cmd->Fb()) || (cmd->SecondFb() && blockedFbs.count(cmd->SecondFb()));
+}
+
+void cOglThread::Hold(cOglCmd *cmd) {
+    held.push_back(cmd);
+    if (cmd->Fb())
+        blockedFbs.insert(cmd->Fb());
+    if (cmd->SecondFb())
+        blockedFbs.insert(cmd->SecondFb());
+}
+
+//fonts are looked up here, as cFont::GetFont() must not be called by the worker thread
+void cOglThread::InitPrewarm(void) {
+    prewarmRange = 0;
+    prewarmChar = 0;
+    prewarmGlyphs = 0;
+    prewarmTime = 0;
+    std::vector<sOglPrewarmRange> ranges;
+    sOglPrewarmRange range = { -1, 0x20, 0x7e };
+    ranges.push_back(range);
+    range.first = 0xa1;
+    range.last = 0xff;
+    ranges.push_back(range);
+    const char *extra = pVMed->GlyphPrewarmRanges();
+    while (extra && *extra) {
+        char *end;
+        range.first = strtoul(extra, &end, 0);
+        range.last = range.first;
+        if (*end == '-')
+            range.last = strtoul(end + 1, &end, 0);
+        if (end == extra)
+            break;
+        if (range.first <= range.last)
+            ranges.push_back(range);
+        extra = end;
+        while (*extra == ',' || *extra == ' ')
+            extra++;
+    }
+    const eDvbFont dvbFonts[] = { fontOsd, fontSml, fontFix };
+    std::vector<int> fonts;
+    for (size_t i = 0; i < sizeof(dvbFonts) / sizeof(dvbFonts[0]); i++) {
+        const cFont *font = cFont::GetFont(dvbFonts[i]);
+        if (!font)
+            continue;
+        int handle = cOglFont::Handle(font->FontName(), font->Size());
+        if (std::find(fonts.begin(), fonts.end(), handle) != fonts.end())
+            continue;
+        fonts.push_back(handle);
+        for (size_t r = 0; r < ranges.size(); r++) {
+            ranges[r].font = handle;
+            prewarmRanges.push_back(ranges[r]);
+        }
+    }
+    if (!prewarmRanges.empty())
+        prewarmChar = prewarmRanges[0].first;
+}
+
+//rasterizes glyphs for one time slice, false if there is nothing left to do
+bool cOglThread::PrewarmGlyphs(void) {
+    if (prewarmRange >= prewarmRanges.size())
+        return false;
+    uint64_t start = cTimeMs::Now();
+    while (prewarmRange < prewarmRanges.size() && cTimeMs::Now() - start < OGL_PREWARM_TIMESLICE) {
+        const sOglPrewarmRange &range = prewarmRanges[prewarmRange];
+        cOglFont *font = cOglFont::Get(range.font);
+        //glyphs missing in the font would only cache copies of the replacement glyph
+        if (font && font->Provides(prewarmChar) && font->Glyph(prewarmChar))
+            prewarmGlyphs++;
+        if (prewarmChar++ >= range.last) {
+            prewarmRange++;
+            if (prewarmRange < prewarmRanges.size())
+                prewarmChar = prewarmRanges[prewarmRange].first;
+        }
+    }
+    prewarmTime += cTimeMs::Now() - start;
+    if (prewarmRange >= prewarmRanges.size()) {
+        dsyslog("[openglosd]pre-warmed %d glyphs in %dms", prewarmGlyphs, prewarmTime);
+        for (size_t i = 0; i < prewarmRanges.size(); i++) {
+            cOglFont *font = cOglFont::Get(prewarmRanges[i].font);
+            if (font)
+                font->SaveGlyphs();
+        }
+    }
+    return true;
+}
+
 bool cOglThread::InitOpenGL(void) {
 #ifdef USE_GLES2
     EGLint iMajorVersion, iMinorVersion;
@@ -1982,9 +4996,8 @@ bool cOglThread::InitOpenGL(void) {
     GL_CHECK(dsyslog("[openglosd]GL Version: \"%s\"", glGetString(GL_VERSION)));
     GL_CHECK(dsyslog("[openglosd]GL Vendor: \"%s\"", glGetString(GL_VENDOR)));
     GL_CHECK(dsyslog("[openglosd]GL Extensions: \"%s\"", glGetString(GL_EXTENSIONS)));
+    etc1Support = strstr((const char *)glGetString(GL_EXTENSIONS), "GL_OES_compressed_ETC1_RGB8_texture") != NULL;
     GL_CHECK(dsyslog("[openglosd]GL Renderer: \"%s\"", glGetString(GL_RENDERER)));
-
-    glesInit();
 #else
     const char *displayName = pVMed->GetX11DisplayName();
     if (!displayName) {
@@ -2022,24 +5035,90 @@ bool cOglThread::InitOpenGL(void) {
 }
 
 bool cOglThread::InitShaders(void) {
+    uint64_t start = cTimeMs::Now();
+    int variants = 0;
+    ProgramCache = new cOglProgramCache();
     for (int i=0; i < stCount; i++) {
         cShader *shader = new cShader();
-        if (!shader->Load((eShaderType)i))
+        if (!shader->Load((eShaderType)i, ShaderVariants[i])) {
+            //without the palette shader bitmaps are converted to ARGB by the CPU
+            if (i == stPalette) {
+                esyslog("[openglosd]palette shader not available, drawing bitmaps as images");
+                delete shader;
+                Shaders[i][ShaderVariants[i]] = NULL;
+                continue;
+            }
+            delete shader;
+            delete ProgramCache;
+            ProgramCache = NULL;
             return false;
-        Shaders[i] = shader;
+        }
+        Shaders[i][ShaderVariants[i]] = shader;
+        //the specialized variants are optional, draws fall back to the generic shader
+        for (int v = 0; v < svCount; v++) {
+            if (v == ShaderVariants[i] || (v & ~ShaderVariants[i]))
+                continue;
+            shader = new cShader();
+            if (shader->Load((eShaderType)i, v)) {
+                Shaders[i][v] = shader;
+                variants++;
+            } else
+                delete shader;
+        }
     }
+    delete ProgramCache;
+    ProgramCache = NULL;
+    paletteShader = Shaders[stPalette][ShaderVariants[stPalette]] != NULL;
+    dsyslog("[openglosd]loaded %d shaders and %d variants in %dms", stCount, variants, (int)(cTimeMs::Now() - start));
     return true;
 }
 
 void cOglThread::DeleteShaders(void) {
-    for (int i=0; i < stCount; i++)
-        delete Shaders[i];
+    cShader *texture[svCount];
+    for (int v = 0; v < svCount; v++)
+        texture[v] = Shaders[stTexture][v];
+    dsyslog("[openglosd]texture draws: %d plain, %d alpha, %d border, %d alpha and border",
+            texture[0] ? texture[0]->Uses() : 0, texture[svAlpha] ? texture[svAlpha]->Uses() : 0,
+            texture[svBorder] ? texture[svBorder]->Uses() : 0,
+            texture[svAlpha | svBorder] ? texture[svAlpha | svBorder]->Uses() : 0);
+    for (int i=0; i < stCount; i++) {
+        for (int v = 0; v < svCount; v++) {
+            delete Shaders[i][v];
+            Shaders[i][v] = NULL;
+        }
+    }
+}
+
+bool cOglThread::InitOutput(void) {
+#ifdef USE_GLES2
+    if (outputBackend == obDmaBuf) {
+        const char *extensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+        if (!extensions || !strstr(extensions, "EGL_MESA_image_dma_buf_export") || !strstr(extensions, "EGL_KHR_gl_texture_2D_image")) {
+            esyslog("[openglosd]EGL cannot export dma-bufs, reading the osd back instead");
+            outputBackend = obReadback;
+        }
+    }
+#else
+    if (outputBackend == obDmaBuf) {
+        esyslog("[openglosd]dma-buf export needs EGL, reading the osd back instead");
+        outputBackend = obReadback;
+    }
+#endif
+    if (outputBackend != obDmaBuf && outputBackend != obReadback)
+        outputBackend = obVdpau;
+    if (outputBackend == obVdpau) {
+        if (!InitVdpauInterop())
+            return false;
+        dsyslog("[openglosd]vdpau interop initialized");
+    }
+    return true;
 }
 
 bool cOglThread::InitVdpauInterop(void) {
     void *vdpDevice = pVMed->GetVDPAUDevice();
     void *procAdress = pVMed->GetVDPAUProcAdress();
 #ifdef USE_GLES2
+    glesInit();
     glGetError(); /* Clear error buffer */
     eglReleaseContext();
     GL_CHECK(glVDPAUInitNV(vdpDevice, procAdress, eglContext, eglDisplay));
@@ -2070,11 +5149,22 @@ void cOglThread::DeleteVertexBuffers(void) {
 }
 
 void cOglThread::Cleanup(void) {
+    textureCache->LogStats();
+    textureCache->Clear();
+    textLayouts->LogStats();
+    cOglGlyph::LogStats();
     DeleteVertexBuffers();
     delete cOglOsd::oFb;
     cOglOsd::oFb = NULL;
+    delete FbMemory;
+    FbMemory = NULL;
+    delete FbPool;
+    FbPool = NULL;
+    delete Uploader;
+    Uploader = NULL;
     DeleteShaders();
-    glVDPAUFiniNV();
+    if (outputBackend == obVdpau)
+        glVDPAUFiniNV();
     cOglFont::Cleanup();
 #ifndef USE_GLES2
     glutExit();
@@ -2090,6 +5180,8 @@ cOglPixmap::cOglPixmap(std::shared_ptr<cOglThread> oglThread, int Layer, const c
     int width = DrawPort.IsEmpty() ? ViewPort.Width() : DrawPort.Width();
     int height = DrawPort.IsEmpty() ? ViewPort.Height() : DrawPort.Height();
     fb = new cOglFb(width, height, ViewPort.Width(), ViewPort.Height());
+    hidden = Layer < 0;
+    fb->SetHidden(hidden);
     dirty = true; 
 }
 
@@ -2099,10 +5191,26 @@ cOglPixmap::~cOglPixmap(void) {
     oglThread->DoCmd(new cOglCmdDeleteFb(fb));
 }
 
+void cOglPixmap::UpdateHidden(void) {
+    //hidden and fully transparent pixmaps are candidates for framebuffer eviction
+    bool hidden = Layer() < 0 || Alpha() == ALPHA_TRANSPARENT;
+    if (hidden == this->hidden)
+        return;
+    this->hidden = hidden;
+    if (oglThread->Active())
+        oglThread->DoCmd(new cOglCmdSetFbHidden(fb, hidden));
+}
+
+void cOglPixmap::SetLayer(int Layer) {
+    cPixmap::SetLayer(Layer);
+    UpdateHidden();
+}
+
 void cOglPixmap::SetAlpha(int Alpha) {
     Alpha = constrain(Alpha, ALPHA_TRANSPARENT, ALPHA_OPAQUE);
     if (Alpha != cPixmap::Alpha()) {
         cPixmap::SetAlpha(Alpha);
+        UpdateHidden();
         SetDirty();
     }
 }
@@ -2127,6 +5235,8 @@ void cOglPixmap::Clear(void) {
     if (!oglThread->Active())
         return;
     LOCK_PIXMAPS;
+    //pending pixels get overwritten anyway
+    pixels.clear();
     oglThread->DoCmd(new cOglCmdFill(fb, clrTransparent));
     SetDirty();
     MarkDrawPortDirty(DrawPort());
@@ -2136,6 +5246,8 @@ void cOglPixmap::Fill(tColor Color) {
     if (!oglThread->Active())
         return;
     LOCK_PIXMAPS;
+    //pending pixels get overwritten anyway
+    pixels.clear();
     oglThread->DoCmd(new cOglCmdFill(fb, Color));
     SetDirty();
     MarkDrawPortDirty(DrawPort());
@@ -2144,22 +5256,62 @@ void cOglPixmap::Fill(tColor Color) {
 void cOglPixmap::DrawImage(const cPoint &Point, const cImage &Image) {
     if (!oglThread->Active())
         return;
+#ifdef OSD_DEBUG
+    uint64_t start = cTimeMs::Now();
+#endif
+    //skins tend to draw the same logos and backgrounds on every redraw
+    cOglTextureCache *cache = oglThread->TextureCache();
+    if (cache->Cacheable(Image.Width(), Image.Height())) {
+        uint64_t key = cOglTextureCache::Key(Image.Data(), Image.Width(), Image.Height());
+        GLuint texture = cache->Acquire(key, Image.Width(), Image.Height());
+        LOCK_PIXMAPS;
+        FlushPixels();
+        cOglCmdDrawImage *cmd;
+        if (texture != GL_NONE) {
+            cmd = new cOglCmdDrawImage(fb, cache, key, texture, Image.Width(), Image.Height(), Point.X(), Point.Y());
+        } else {
+            tColor *argb = MALLOC(tColor, Image.Width() * Image.Height());
+            if (!argb)
+                return;
+            memcpy(argb, Image.Data(), sizeof(tColor) * Image.Width() * Image.Height());
+            cmd = new cOglCmdDrawImage(fb, std::shared_ptr<const tColor>(argb, free), Image.Width(), Image.Height(), Point.X(), Point.Y());
+            cmd->SetCacheKey(cache, key);
+        }
+        oglThread->DoCmd(cmd);
+        SetDirty();
+        MarkDrawPortDirty(cRect(Point, cSize(Image.Width(), Image.Height())).Intersected(DrawPort().Size()));
+#ifdef OSD_DEBUG
+        dsyslog("[openglosd]DrawImage %dx%d: %dms on the calling thread (%s)", Image.Width(), Image.Height(), (int)(cTimeMs::Now() - start), texture != GL_NONE ? "cached" : "uploaded");
+#endif
+        return;
+    }
+    //the caller may delete Image right after this call, so we need a copy
     tColor *argb = MALLOC(tColor, Image.Width() * Image.Height());
     if (!argb)
         return;
     memcpy(argb, Image.Data(), sizeof(tColor) * Image.Width() * Image.Height());
+    DrawImageData(Point, std::shared_ptr<const tColor>(argb, free), Image.Width(), Image.Height());
+#ifdef OSD_DEBUG
+    dsyslog("[openglosd]DrawImage %dx%d: %dms on the calling thread", Image.Width(), Image.Height(), (int)(cTimeMs::Now() - start));
+#endif
+}
 
-    oglThread->DoCmd(new cOglCmdDrawImage(fb, argb, Image.Width(), Image.Height(), Point.X(), Point.Y()));
+void cOglPixmap::DrawImageData(const cPoint &Point, std::shared_ptr<const tColor> argb, int Width, int Height) {
+    LOCK_PIXMAPS;
+    FlushPixels();
+    oglThread->DoCmd(new cOglCmdDrawImage(fb, argb, Width, Height, Point.X(), Point.Y()));
 
     SetDirty();
-    MarkDrawPortDirty(cRect(Point, cSize(Image.Width(), Image.Height())).Intersected(DrawPort().Size()));
+    MarkDrawPortDirty(cRect(Point, cSize(Width, Height)).Intersected(DrawPort().Size()));
 }
 
 void cOglPixmap::DrawImage(const cPoint &Point, int ImageHandle) {
     if (!oglThread->Active())
         return;
-    if (ImageHandle < 0 && oglThread->GetImageRef(ImageHandle)) {
-            sOglImage *img = oglThread->GetImageRef(ImageHandle);
+    LOCK_PIXMAPS;
+    FlushPixels();
+    sOglImage *img = ImageHandle < 0 ? oglThread->UseImage(ImageHandle) : NULL;
+    if (img) {
             oglThread->DoCmd(new cOglCmdDrawTexture(fb, img, Point.X(), Point.Y()));
     }
     /*
@@ -2173,49 +5325,117 @@ void cOglPixmap::DrawImage(const cPoint &Point, int ImageHandle) {
     MarkDrawPortDirty(DrawPort());
 }
 
+void cOglPixmap::FlushPixels(void) const {
+    if (pixels.empty())
+        return;
+    if (oglThread->Active())
+        oglThread->DoCmd(new cOglCmdDrawPixels(fb, pixels));
+    pixels.clear();
+}
+
 void cOglPixmap::DrawPixel(const cPoint &Point, tColor Color) {
-    esyslog("[openglosd] DrawPixel %d %d color %x not implemented in OpenGl OSD", Point.X(), Point.X(), Color);
+    if (!oglThread->Active())
+        return;
+    LOCK_PIXMAPS;
+    if (!cRect(DrawPort().Size()).Contains(Point))
+        return;
+    //pixels are collected and drawn with one command before anything else is drawn
+    glm::vec4 col;
+    ConvertColor(Color, col);
+    GLfloat vertex[] = { Point.X() + 0.5f, Point.Y() + 0.5f, col.r, col.g, col.b, col.a };
+    pixels.insert(pixels.end(), vertex, vertex + 6);
+    if (pixels.size() >= OGL_PIXELBATCH_SIZE * 6)
+        FlushPixels();
+    SetDirty();
+    MarkDrawPortDirty(cRect(Point, cSize(1, 1)));
+}
+
+static bool CopyBitmap(const cBitmap &Bitmap, tIndex *&indices, tColor *&palette) {
+    int numColors = 0;
+    const tColor *colors = Bitmap.Colors(numColors);
+    indices = MALLOC(tIndex, Bitmap.Width() * Bitmap.Height());
+    palette = MALLOC(tColor, MAXNUMCOLORS);
+    if (!indices || !palette) {
+        free(indices);
+        free(palette);
+        return false;
+    }
+    memcpy(indices, Bitmap.Data(0, 0), sizeof(tIndex) * Bitmap.Width() * Bitmap.Height());
+    memset(palette, 0, sizeof(tColor) * MAXNUMCOLORS);
+    memcpy(palette, colors, sizeof(tColor) * std::min(numColors, MAXNUMCOLORS));
+    return true;
 }
 
 void cOglPixmap::DrawBitmap(const cPoint &Point, const cBitmap &Bitmap, tColor ColorFg, tColor ColorBg, bool Overlay) {
     if (!oglThread->Active())
         return;
     LOCK_PIXMAPS;
+    FlushPixels();
     bool specialColors = ColorFg || ColorBg;
+    if (oglThread->PaletteShader()) {
+        //hand over the index plane and the palette, the GL thread does the lookup
+        tIndex *indices;
+        tColor *palette;
+        if (!CopyBitmap(Bitmap, indices, palette))
+            return;
+        if (specialColors) {
+            palette[0] = ColorBg;
+            palette[1] = ColorFg;
+        }
+        oglThread->DoCmd(new cOglCmdDrawBitmap(fb, indices, palette, Bitmap.Width(), Bitmap.Height(), Point.X(), Point.Y(), Overlay));
+        SetDirty();
+        MarkDrawPortDirty(cRect(Point, cSize(Bitmap.Width(), Bitmap.Height())).Intersected(DrawPort().Size()));
+        return;
+    }
     tColor *argb = MALLOC(tColor, Bitmap.Width() * Bitmap.Height());
     if (!argb)
         return;
 
-    tColor *p = argb;
-    for (int py = 0; py < Bitmap.Height(); py++)
-        for (int px = 0; px < Bitmap.Width(); px++) {
-                tIndex index = *Bitmap.Data(px, py);
-                *p++ = (!index && Overlay) ? clrTransparent : (specialColors ?
-                        (index == 0 ? ColorBg : index == 1 ? ColorFg :
-                                Bitmap.Color(index)) : Bitmap.Color(index));
-        }
-    oglThread->DoCmd(new cOglCmdDrawImage(fb, argb, Bitmap.Width(), Bitmap.Height(), Point.X(), Point.Y(), Overlay));
+    //resolve overlay and special colors once in the palette, not per pixel
+    int numColors = 0;
+    const tColor *colors = Bitmap.Colors(numColors);
+    tColor palette[MAXNUMCOLORS];
+    memset(palette, 0, sizeof(palette));
+    memcpy(palette, colors, sizeof(tColor) * std::min(numColors, MAXNUMCOLORS));
+    if (specialColors) {
+        palette[0] = ColorBg;
+        palette[1] = ColorFg;
+    }
+    if (Overlay)
+        palette[0] = clrTransparent;
+    ConvertBitmapToArgb(Bitmap, palette, argb);
+    oglThread->DoCmd(new cOglCmdDrawImage(fb, std::shared_ptr<const tColor>(argb, free), Bitmap.Width(), Bitmap.Height(), Point.X(), Point.Y(), Overlay));
     SetDirty();
     MarkDrawPortDirty(cRect(Point, cSize(Bitmap.Width(), Bitmap.Height())).Intersected(DrawPort().Size()));
 }
 
+bool cOglPixmap::DrawScaledBitmap(const cPoint &Point, const cBitmap &Bitmap, double FactorX, double FactorY, bool AntiAlias, sOglBitmapTextures *bitmapTextures) {
+    if (!oglThread->Active() || !oglThread->PaletteShader())
+        return false;
+    LOCK_PIXMAPS;
+    FlushPixels();
+    tIndex *indices;
+    tColor *palette;
+    if (!CopyBitmap(Bitmap, indices, palette))
+        return true;
+    oglThread->DoCmd(new cOglCmdDrawBitmap(fb, indices, palette, Bitmap.Width(), Bitmap.Height(), Point.X(), Point.Y(), false,
+                                           FactorX, FactorY, AntiAlias, bitmapTextures));
+    SetDirty();
+    MarkDrawPortDirty(cRect(Point, cSize(ceil(Bitmap.Width() * FactorX), ceil(Bitmap.Height() * FactorY))).Intersected(DrawPort().Size()));
+    return true;
+}
+
 void cOglPixmap::DrawText(const cPoint &Point, const char *s, tColor ColorFg, tColor ColorBg, const cFont *Font, int Width, int Height, int Alignment) {
     if (!oglThread->Active())
         return;
     LOCK_PIXMAPS;
-    int len = s ? Utf8StrLen(s) : 0;
-    unsigned int *symbols = MALLOC(unsigned int, len + 1);
-    if (!symbols)
-        return;
-
-    if (len)
-        Utf8ToArray(s, symbols, len + 1);
-    else
-        symbols[0] = 0;
+    FlushPixels();
+    int font = cOglFont::Handle(Font->FontName(), Font->Size());
+    std::shared_ptr<sOglTextLayout> layout = oglThread->TextLayouts()->Get(font, s);
 
     int x = Point.X();
     int y = Point.Y();
-    int w = Font->Width(s);
+    int w = layout->width;
     int h = Font->Height();
     int limitX = 0;
     int cw = Width ? Width : w;
@@ -2254,7 +5474,7 @@ void cOglPixmap::DrawText(const cPoint &Point, const char *s, tColor ColorFg, tC
             }
         }
     }
-    oglThread->DoCmd(new cOglCmdDrawText(fb, x, y, symbols, limitX, Font->FontName(), Font->Size(), ColorFg));
+    oglThread->DoCmd(new cOglCmdDrawText(fb, x, y, layout, limitX, ColorFg));
 
     SetDirty();
     MarkDrawPortDirty(r);
@@ -2264,6 +5484,7 @@ void cOglPixmap::DrawRectangle(const cRect &Rect, tColor Color) {
     if (!oglThread->Active())
         return;
     LOCK_PIXMAPS;
+    FlushPixels();
     oglThread->DoCmd(new cOglCmdDrawRectangle(fb, Rect.X(), Rect.Y(), Rect.Width(), Rect.Height(), Color));
     SetDirty();
     MarkDrawPortDirty(Rect);
@@ -2273,6 +5494,7 @@ void cOglPixmap::DrawEllipse(const cRect &Rect, tColor Color, int Quadrants) {
     if (!oglThread->Active())
         return;
     LOCK_PIXMAPS;
+    FlushPixels();
     oglThread->DoCmd(new cOglCmdDrawEllipse(fb, Rect.X(), Rect.Y(), Rect.Width(), Rect.Height(), Color, Quadrants));
     SetDirty();
     MarkDrawPortDirty(Rect);
@@ -2282,25 +5504,109 @@ void cOglPixmap::DrawSlope(const cRect &Rect, tColor Color, int Type) {
     if (!oglThread->Active())
         return;
     LOCK_PIXMAPS;
+    FlushPixels();
     oglThread->DoCmd(new cOglCmdDrawSlope(fb, Rect.X(), Rect.Y(), Rect.Width(), Rect.Height(), Color, Type));
     SetDirty();
     MarkDrawPortDirty(Rect);
 }
 
 void cOglPixmap::Render(const cPixmap *Pixmap, const cRect &Source, const cPoint &Dest) {
-    esyslog("[openglosd] Render %d %d %d not implemented in OpenGl OSD", Pixmap->ViewPort().X(), Source.X(), Dest.X());
+    if (!oglThread->Active())
+        return;
+    LOCK_PIXMAPS;
+    const cOglPixmap *pm = dynamic_cast<const cOglPixmap *>(Pixmap);
+    if (!pm)
+        return;
+    FlushPixels();
+    pm->FlushPixels();
+    int vx = Dest.X() - Source.X();
+    int vy = Dest.Y() - Source.Y();
+    cRect d = Source.Intersected(pm->DrawPort().Size()).Shifted(vx, vy).Intersected(DrawPort().Size());
+    if (d.IsEmpty())
+        return;
+    oglThread->DoCmd(new cOglCmdCopyFb(fb, pm->Fb(), d.X() - vx, d.Y() - vy, d.Width(), d.Height(), d.X(), d.Y(), true));
+    SetDirty();
+    MarkDrawPortDirty(d);
 }
 
 void cOglPixmap::Copy(const cPixmap *Pixmap, const cRect &Source, const cPoint &Dest) {
-    esyslog("[openglosd] Copy %d %d %d not implemented in OpenGl OSD", Pixmap->ViewPort().X(), Source.X(), Dest.X());
+    if (!oglThread->Active())
+        return;
+    LOCK_PIXMAPS;
+    const cOglPixmap *pm = dynamic_cast<const cOglPixmap *>(Pixmap);
+    if (!pm)
+        return;
+    FlushPixels();
+    pm->FlushPixels();
+    int vx = Dest.X() - Source.X();
+    int vy = Dest.Y() - Source.Y();
+    cRect d = Source.Intersected(pm->DrawPort().Size()).Shifted(vx, vy).Intersected(DrawPort().Size());
+    if (d.IsEmpty())
+        return;
+    oglThread->DoCmd(new cOglCmdCopyFb(fb, pm->Fb(), d.X() - vx, d.Y() - vy, d.Width(), d.Height(), d.X(), d.Y(), false));
+    SetDirty();
+    MarkDrawPortDirty(d);
 }
 
 void cOglPixmap::Scroll(const cPoint &Dest, const cRect &Source) {
-    esyslog("[openglosd] Scroll %d %d not implemented in OpenGl OSD", Source.X(), Dest.X());
+    if (!oglThread->Active())
+        return;
+    LOCK_PIXMAPS;
+    FlushPixels();
+    cRect s;
+    if (&Source == &cRect::Null)
+        s = cRect(DrawPort().Size());
+    else
+        s = Source.Intersected(DrawPort().Size());
+    int vx = Dest.X() - Source.X();
+    int vy = Dest.Y() - Source.Y();
+    cRect d = s.Shifted(vx, vy).Intersected(DrawPort().Size());
+    if (d.IsEmpty() || (vx == 0 && vy == 0))
+        return;
+    oglThread->DoCmd(new cOglCmdCopyFb(fb, fb, d.X() - vx, d.Y() - vy, d.Width(), d.Height(), d.X(), d.Y(), false));
+    SetDirty();
+    MarkDrawPortDirty(d);
 }
 
 void cOglPixmap::Pan(const cPoint &Dest, const cRect &Source) {
-    esyslog("[openglosd] Pan %d %d not implemented in OpenGl OSD", Source.X(), Dest.X());
+    if (!oglThread->Active())
+        return;
+    LOCK_PIXMAPS;
+    FlushPixels();
+    //unlike Scroll(), Source and Dest are relative to the view port
+    cRect vp(ViewPort().Size());
+    cRect s;
+    if (&Source == &cRect::Null)
+        s = vp;
+    else
+        s = Source.Intersected(vp);
+    bool full = s == vp;
+    s = s.Intersected(DrawPort());
+    int vx = Dest.X() - Source.X();
+    int vy = Dest.Y() - Source.Y();
+    cRect d = s.Shifted(vx, vy).Intersected(vp).Intersected(DrawPort());
+    if (d.IsEmpty() || (vx == 0 && vy == 0))
+        return;
+    //the framebuffer holds the draw port
+    int ox = DrawPort().X();
+    int oy = DrawPort().Y();
+    oglThread->DoCmd(new cOglCmdCopyFb(fb, fb, d.X() - vx - ox, d.Y() - vy - oy, d.Width(), d.Height(), d.X() - ox, d.Y() - oy, false));
+    //move the draw port against the data, the copied part stays where it was on the screen,
+    //only a partial source lets the rest of the view port move
+    SetDrawPortPoint(DrawPort().Point().Shifted(-vx, -vy), !full);
+    if (!full)
+        return;
+    //what is left of the source shows draw port data the copy did not reach
+    cRect kept = d.Shifted(-vx, -vy);
+    SetDirty();
+    if (kept.Top() > s.Top())
+        MarkViewPortDirty(cRect(s.X(), s.Y(), s.Width(), kept.Top() - s.Top()));
+    if (kept.Bottom() < s.Bottom())
+        MarkViewPortDirty(cRect(s.X(), kept.Bottom() + 1, s.Width(), s.Bottom() - kept.Bottom()));
+    if (kept.Left() > s.Left())
+        MarkViewPortDirty(cRect(s.X(), kept.Y(), kept.Left() - s.Left(), kept.Height()));
+    if (kept.Right() < s.Right())
+        MarkViewPortDirty(cRect(kept.Right() + 1, kept.Y(), s.Right() - kept.Right(), kept.Height()));
 }
 
 /******************************************************************************
@@ -2319,9 +5625,9 @@ cOglOsd::cOglOsd(int Left, int Top, uint Level, std::shared_ptr<cOglThread> oglT
     cDevice::PrimaryDevice()->GetOsdSize(osdWidth, osdHeight, osdPixelAspect);
     dsyslog("[openglosd]cOglOsd osdLeft %d osdTop %d screenWidth %d screenHeight %d", Left, Top, osdWidth, osdHeight);
 
-    //create vdpau output framebuffer
+    //create output framebuffer
     if (!oFb) {
-        oFb = new cOglOutputFb(osdWidth, osdHeight);
+        oFb = cOglOutputFb::Create(oglThread->OutputBackend(), osdWidth, osdHeight);
         oglThread->DoCmd(new cOglCmdInitOutputFb(oFb));
     }
 }
@@ -2329,6 +5635,7 @@ cOglOsd::cOglOsd(int Left, int Top, uint Level, std::shared_ptr<cOglThread> oglT
 cOglOsd::~cOglOsd() {
 	pVMed->CloseOsd();
     SetActive(false);
+    DeleteBitmapTextures();
     oglThread->DoCmd(new cOglCmdDeleteFb(bFb));
 }
 
@@ -2407,6 +5714,9 @@ void cOglOsd::Flush(void) {
     if (!oglThread->Active())
         return;
     LOCK_PIXMAPS;
+    for (int i = 0; i < oglPixmaps.Size(); i++)
+        if (oglPixmaps[i])
+            oglPixmaps[i]->FlushPixels();
     //check if any pixmap is dirty
     bool dirty = false;
     for (int i = 0; i < oglPixmaps.Size() && !dirty; i++)
@@ -2424,13 +5734,15 @@ void cOglOsd::Flush(void) {
         for (int i = 0; i < oglPixmaps.Size(); i++) {
             if (oglPixmaps[i]) {
                 if (oglPixmaps[i]->Layer() == layer) {
-                    oglThread->DoCmd(new cOglCmdRenderFbToBufferFb( oglPixmaps[i]->Fb(), 
-                                                                    bFb, 
-                                                                    oglPixmaps[i]->ViewPort().X(), 
-                                                                    (!isSubtitleOsd) ? oglPixmaps[i]->ViewPort().Y() : 0,
-                                                                    oglPixmaps[i]->Alpha(),
-                                                                    oglPixmaps[i]->DrawPort().X(),
-                                                                    oglPixmaps[i]->DrawPort().Y()));
+                    //fully transparent pixmaps would not change the buffer
+                    if (oglPixmaps[i]->Alpha() != ALPHA_TRANSPARENT)
+                        oglThread->DoCmd(new cOglCmdRenderFbToBufferFb( oglPixmaps[i]->Fb(), 
+                                                                        bFb, 
+                                                                        oglPixmaps[i]->ViewPort().X(), 
+                                                                        (!isSubtitleOsd) ? oglPixmaps[i]->ViewPort().Y() : 0,
+                                                                        oglPixmaps[i]->Alpha(),
+                                                                        oglPixmaps[i]->DrawPort().X(),
+                                                                        oglPixmaps[i]->DrawPort().Y()));
                     oglPixmaps[i]->SetDirty(false);
                 }
             }
@@ -2442,9 +5754,48 @@ void cOglOsd::Flush(void) {
 }
 
 void cOglOsd::DrawScaledBitmap(int x, int y, const cBitmap &Bitmap, double FactorX, double FactorY, bool AntiAlias) {
-    (void)FactorX;
-    (void)FactorY;
-    (void)AntiAlias;
+    if (!oglThread->Active() || oglPixmaps.Size() == 0 || !oglPixmaps[0])
+        return;
+#ifdef OSD_DEBUG
+    uint64_t start = cTimeMs::Now();
+#endif
     int yNew = y - oglPixmaps[0]->ViewPort().Y();
-    oglPixmaps[0]->DrawBitmap(cPoint(x, yNew), Bitmap);
+    //subtitle regions get redrawn at the same positions, so keep their textures
+    uint64_t key = ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+    sOglBitmapTextures *textures = NULL;
+    std::map<uint64_t, sOglBitmapTextures *>::iterator it = bitmapTextures.find(key);
+    if (it != bitmapTextures.end()) {
+        textures = it->second;
+    } else {
+        if (bitmapTextures.size() >= OGL_MAX_BITMAP_REGIONS)
+            DeleteBitmapTextures();
+        textures = new sOglBitmapTextures;
+        textures->textures[0] = textures->textures[1] = GL_NONE;
+        textures->width = 0;
+        textures->height = 0;
+        bitmapTextures[key] = textures;
+    }
+    //the GPU scales and filters, no resampling on the CPU
+    if (!oglPixmaps[0]->DrawScaledBitmap(cPoint(x, yNew), Bitmap, FactorX, FactorY, AntiAlias, textures)) {
+        const cBitmap *b = &Bitmap;
+        if (fabs(FactorX - 1.0) > 1e-6 || fabs(FactorY - 1.0) > 1e-6)
+            b = Bitmap.Scaled(FactorX, FactorY, AntiAlias);
+        oglPixmaps[0]->DrawBitmap(cPoint(x, yNew), *b);
+        if (b != &Bitmap)
+            delete b;
+    }
+#ifdef OSD_DEBUG
+    dsyslog("[openglosd]DrawScaledBitmap %dx%d scaled %.2fx%.2f: %dms", Bitmap.Width(), Bitmap.Height(), FactorX, FactorY, (int)(cTimeMs::Now() - start));
+#endif
+}
+
+void cOglOsd::DeleteBitmapTextures(void) {
+    if (bitmapTextures.empty())
+        return;
+    std::vector<sOglBitmapTextures *> textures;
+    for (std::map<uint64_t, sOglBitmapTextures *>::iterator it = bitmapTextures.begin(); it != bitmapTextures.end(); ++it)
+        textures.push_back(it->second);
+    bitmapTextures.clear();
+    //queued commands may still use them
+    oglThread->DoCmd(new cOglCmdDeleteBitmapTextures(textures));
 }
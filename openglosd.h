@@ -18,6 +18,8 @@
 #include FT_FREETYPE_H
 #include FT_LCD_FILTER_H
 #include FT_STROKER_H
+#include FT_ADVANCES_H
+#include FT_SIZES_H
 
 #undef __FTERRORS_H__
 #define FT_ERRORDEF( e, v, s )  { e, s },
@@ -29,8 +31,15 @@ const struct {
 } FT_Errors[] =
 #include FT_ERRORS_H
 
+#include <deque>
+#include <list>
+#include <map>
 #include <memory>
 #include <queue>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <vdr/osd.h>
 #include <vdr/thread.h>
@@ -40,6 +49,20 @@ struct sOglImage {
     GLint width;
     GLint height;
     bool used;
+    bool evicted;       // texture is (about to be) moved to backup
+    bool uploading;     // store command is still uploading chunks
+    tColor *backup;     // CPU copy of an evicted texture
+    GLubyte *etc1;      // ETC1 data of a compressed texture, re-uploaded after eviction
+    bool compressed;    // etc1 is set, changed under imageMutex, etc1 itself belongs to the GL thread
+    uint64_t lastUsed;
+    long memSize;       // GPU memory accounted for the texture
+    int serial;         // changes whenever the slot is reused or dropped
+};
+
+enum eOglOutputBackend {
+    obVdpau,        // NV_vdpau_interop into the output surfaces of the output device
+    obDmaBuf,       // dma-buf export of the osd textures, imported by the output device (EGL only)
+    obReadback      // asynchronous readback into memory provided by the output device
 };
 
 class IVdpauMediator {
@@ -54,6 +77,20 @@ public:
 	virtual int & MaxSizeGPUImageCache() = 0;
 	virtual const char * GetX11DisplayName() = 0;
 	virtual void SetX11DisplayName(const char *) = 0;
+	virtual int MaxSizeGPUFbMemory() { return 0; }	// MB, 0 = unlimited
+	virtual int GPUImageStorage() { return 0; }	// eOglImageStorage flags, opt-in
+	// 2 enables double buffering, CloseOsd() then has to clear both surfaces
+	virtual int VDPAUOutputSurfaces() { return 1; }
+	virtual void * GetVDPAUOutputSurfaceAt(int index) { return index ? NULL : GetVDPAUOutputSurface(); }
+	virtual void ActivateOsdSurface(int index) { (void)index; ActivateOsd(); }
+	virtual int OutputBackend() { return obVdpau; }	// eOglOutputBackend
+	// fd stays owned by the osd and valid until CloseOsd(), the same fds are handed over again
+	virtual void ActivateOsdDmaBuf(int fd, int fourcc, uint64_t modifier, int width, int height, int stride, int offset) { ActivateOsd(); }
+	// destination of the readback backend, NULL discards the pixels
+	virtual tColor * GetOsdPixelBuffer(int width, int height) { return NULL; }
+	// glyphs rasterized at startup besides Latin-1, e.g. "0x400-0x4ff,0x20ac"
+	virtual const char * GlyphPrewarmRanges() { return NULL; }
+	virtual int MaxSizeGPUGlyphMemory() { return 0; }	// MB, 0 = OGL_GLYPH_MAX_MEMORY
 };
 
 extern IVdpauMediator * pVMed;
@@ -62,6 +99,7 @@ extern IVdpauMediator * pVMed;
 ****************************************************************************************/
 
 void ConvertColor(const GLint &colARGB, glm::vec4 &col);
+void ConvertBitmapToArgb(const cBitmap &Bitmap, const tColor *palette, tColor *argb);
 
 /****************************************************************************************
 * cShader
@@ -70,19 +108,31 @@ enum eShaderType {
     stRect,
     stTexture,
     stText,
+    stPixel,
+    stPalette,
     stCount
 };
 
+//specializations compiled in with #defines, the cheapest one is chosen per draw
+enum eShaderVariant {
+    svAlpha = 1,                    // modulated by the alpha uniform
+    svBorder = 2,                   // coordinates outside the texture give the border color
+    svCount = 4
+};
+
 class cShader {
 private:
     eShaderType type;
+    int variant;
     GLuint id;
+    int uses;
     bool Compile(const char *vertexCode, const char *fragmentCode);
     bool CheckCompileErrors(GLuint object, bool program = false);
 public:
-    cShader(void) {};
+    cShader(void) { uses = 0; };
     virtual ~cShader(void) {};
-    bool Load(eShaderType type);
+    bool Load(eShaderType type, int variant = 0);
+    int Uses(void) { return uses; };
     void Use(void);
     void SetFloat    (const GLchar *name, GLfloat value);
     void SetInteger  (const GLchar *name, GLint value);
@@ -92,69 +142,299 @@ public:
     void SetMatrix4  (const GLchar *name, const glm::mat4 &matrix);
 };
 
+/****************************************************************************************
+* cOglProgramCache
+* Keeps linked shader programs on disk, so they are not compiled at every start
+****************************************************************************************/
+#define OGL_PROGRAMCACHE_VERSION 1
+
+struct sOglProgramCacheHeader {
+    char magic[4];                  // "OGLP"
+    uint32_t version;
+    uint32_t format;                // of the driver's program binary
+    uint32_t length;
+    uint64_t hash;                  // of the driver and the shader sources
+};
+
+class cOglProgramCache {
+private:
+    cString dir;
+    bool supported;
+    uint64_t driverHash;
+    int loaded;
+    int stored;
+    cString FileName(int type, int variant);
+public:
+    cOglProgramCache(void);
+    virtual ~cOglProgramCache(void);
+    uint64_t Hash(const char *vertexCode, const char *fragmentCode, const char *defines);
+    void PrepareLink(GLuint program);
+    bool Load(GLuint program, int type, int variant, uint64_t hash);
+    void Store(GLuint program, int type, int variant, uint64_t hash);
+};
+
+/****************************************************************************************
+* cOglUploader
+* Uploads texture data in chunks of rows, sized to take about a time slice each
+****************************************************************************************/
+#define OGL_UPLOAD_TIMESLICE 4                  // ms a chunk of a large upload should take at most
+#define OGL_UPLOAD_MIN_CHUNK (256 * 1024)
+#define OGL_UPLOAD_MAX_CHUNK (16 * 1024 * 1024)
+
+class cOglUploader {
+private:
+    long chunkSize;
+    void Adapt(long size, int elapsed);
+public:
+    cOglUploader(void);
+    virtual ~cOglUploader(void);
+    int ChunkRows(int rowBytes);
+    void Upload(GLint width, GLint y, GLint rows, GLenum format, GLenum type, const void *data, int rowBytes);
+};
+
+/****************************************************************************************
+* cOglGlyphCache
+* Rasterized glyphs of a font kept on disk, so they survive restarts
+****************************************************************************************/
+#define OGL_GLYPHCACHE_VERSION 2
+#define OGL_GLYPHCACHE_MAX_AGE 8    // glyphs not drawn during this many saves are dropped
+#define OGL_GLYPH_STROKE 16         // outline width in 1/64 pixel
+
+struct sOglGlyphCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t ftVersion;
+    uint32_t size;
+    uint32_t stroke;
+    uint32_t count;
+    uint32_t generation;            // number of saves so far
+    uint64_t fontHash;
+};
+
+struct sOglGlyphCacheEntry {
+    uint32_t charCode;
+    uint32_t glyphIndex;
+    int32_t bearingLeft;
+    int32_t bearingTop;
+    int32_t width;
+    int32_t height;
+    int32_t advanceX;
+    uint32_t offset;                // of the bitmap, from the start of the file
+    uint32_t lastUsed;              // generation of the last save the glyph was drawn before
+};
+
+class cOglGlyphCache {
+private:
+    cString fileName;
+    uint64_t fontHash;
+    int size;
+    GLubyte *map;
+    size_t mapSize;
+    const sOglGlyphCacheEntry *entries;
+    int count;
+    uint32_t generation;
+    std::unordered_map<uint, int> index;        // entry of each mapped code point
+    std::vector<uint32_t> lastUsed;             // of the mapped entries, updated when drawn
+    std::vector<sOglGlyphCacheEntry> added;
+    std::vector<GLubyte> addedBitmaps;
+    bool Load(void);
+    void Unmap(void);
+public:
+    cOglGlyphCache(uint64_t fontHash, int size);
+    virtual ~cOglGlyphCache(void);
+    int Count(void) { return count; };
+    const sOglGlyphCacheEntry *Entry(int i) { return &entries[i]; };
+    const sOglGlyphCacheEntry *Find(uint charCode);
+    const GLubyte *Bitmap(const sOglGlyphCacheEntry *entry) { return map + entry->offset; };
+    void Use(const sOglGlyphCacheEntry *entry);
+    void Add(const sOglGlyphCacheEntry &entry, const GLubyte *bitmap, int pitch);
+    void Save(void);
+};
+
 /****************************************************************************************
 * cOglGlyph
 ****************************************************************************************/
-class cOglGlyph : public cListObject {
-private:
-    struct tKerning {
-        public:
-            tKerning(uint prevSym, GLfloat kerning = 0.0f)  {
-                this->prevSym = prevSym;
-                this->kerning = kerning;
-            }
-            uint prevSym;
-            GLfloat kerning;
-    };
+#define OGL_GLYPH_MAX_MEMORY 8      // MB of glyph textures, least recently drawn ones are evicted
+
+struct sOglGlyphStats {
+    long memUsed;
+    long memPeak;
+    long memBudget;
+    int resident;
+    int uploads;
+    int evictions;
+    int reloads;                    // evicted glyphs loaded again
+};
+
+class cOglFont;
+
+class cOglGlyph {
+private:
+    static std::list<cOglGlyph*> resident;     // glyphs with a texture, most recently drawn first
+    static cMutex statsMutex;
+    static sOglGlyphStats stats;
+    const cOglFont *font;
+    std::list<cOglGlyph*>::iterator lruPos;
     uint charCode;
+    FT_UInt glyphIndex;
     int bearingLeft;
     int bearingTop;
     int width;
     int height;
     int advanceX;      
-    cVector<tKerning> kerningCache;
-    GLuint texture;
-    void LoadTexture(FT_BitmapGlyph ftGlyph);
+    GLuint texture;                 // 0 while evicted
+    static void Reserve(long size);
+    void Evict(void);
 public:
-    cOglGlyph(uint charCode, FT_BitmapGlyph ftGlyph);
+    cOglGlyph(const cOglFont *font, uint charCode, FT_UInt glyphIndex, FT_BitmapGlyph ftGlyph);
+    cOglGlyph(const cOglFont *font, const sOglGlyphCacheEntry *entry, const GLubyte *bitmap);
+    static void SetMemoryBudget(long bytes);
+    static sOglGlyphStats Stats(void);
+    static void LogStats(void);
+    void LoadTexture(const GLubyte *buffer);
+    long Size(void) const { return (long)width * height; }
     virtual ~cOglGlyph();
     uint CharCode(void) { return charCode; }
+    FT_UInt GlyphIndex(void) { return glyphIndex; }
     int AdvanceX(void) { return advanceX; }
     int BearingLeft(void) const { return bearingLeft; }
     int BearingTop(void) const { return bearingTop; }
     int Width(void) const { return width; }
     int Height(void) const { return height; }
-    int GetKerningCache(uint prevSym);
-    void SetKerningCache(uint prevSym, int kerning);
     void BindTexture(void);
 };
 
 /****************************************************************************************
 * cOglFont
 ****************************************************************************************/
-class cOglFont : public cListObject {
+#define OGL_GLYPH_DIRECT 256        // code points below are looked up directly
+#define OGL_GLYPH_TABLE_MIN 64      // initial size of the glyph hash table, a power of two
+
+struct sOglGlyphSlot {
+    uint charCode;
+    cOglGlyph *glyph;               // NULL marks a free slot
+};
+
+/****************************************************************************************
+* cOglFontMetrics
+* Advances and kerning of a font, shared by the drawing threads and the worker thread
+****************************************************************************************/
+struct sOglGlyphMetrics {
+    FT_UInt glyphIndex;
+    int advanceX;
+};
+
+struct sOglFace;
+
+class cOglFontMetrics {
+private:
+    cMutex mutex;
+    cString fontFile;
+    int size;
+    sOglFace *shared;               // its metrics face is shared by all sizes of the file
+    FT_Size ftSize;
+    bool opened;
+    bool hasKerning;
+    std::unordered_map<uint, sOglGlyphMetrics> glyphs;
+    std::unordered_map<uint64_t, int> kerning;     // keyed by both glyph indices
+    bool Open(void);
+    const sOglGlyphMetrics *Lookup(uint charCode);
+public:
+    cOglFontMetrics(const char *fontFile, int size);
+    virtual ~cOglFontMetrics(void);
+    void Set(uint charCode, FT_UInt glyphIndex, int advanceX);
+    int Width(const uint *symbols);
+};
+
+/****************************************************************************************
+* cOglFaceLoader
+* Opens the FreeType faces of memory-mapped font files in the background, one per file,
+* kept until the plugin shuts down
+****************************************************************************************/
+struct sOglFace {
+    void *data;                     // the mapped font file
+    size_t dataSize;
+    uint64_t hash;                  // FNV-1a of the file content
+    FT_Face face;                   // NULL if the file could not be opened
+    FT_Stroker stroker;             // reused for every glyph of the face
+    FT_Face metricsFace;            // for the drawing threads, opened on first use
+    cMutex *metricsMutex;           // guards metricsFace and its sizes
+    int openTime;                   // ms
+    bool loaded;
+};
+
+class cOglFaceLoader : public cThread {
+private:
+    static cMutex instanceMutex;
+    static cOglFaceLoader *instance;
+    FT_Library ftLib;
+    cMutex ftMutex;                 // creation and destruction of faces and sizes
+    cMutex mutex;
+    cCondVar loadedVar;
+    cCondWait wait;
+    std::map<std::string, sOglFace *> faces;
+    std::queue<std::string> jobs;
+    void Load(const char *fileName, sOglFace *face);
+protected:
+    virtual void Action(void);
+public:
+    cOglFaceLoader(void);
+    virtual ~cOglFaceLoader(void);
+    static cOglFaceLoader *Instance(void);
+    static void Shutdown(void);
+    void Request(const char *fileName);
+    sOglFace *Get(const char *fileName);
+    sOglFace *MetricsFace(const char *fileName);
+    FT_Size NewSize(FT_Face face);
+    void DoneSize(FT_Size size);
+};
+
+struct sOglFontHandle {
+    cString name;
+    int size;
+    cOglFontMetrics *metrics;       // lives as long as the handle
+    cOglFont *font;                 // created by the first text drawn with the handle
+};
+
+class cOglFont {
 private:
-    static bool initiated;
     cString name;
     int size;
     int height;
     int bottom;
-    static FT_Library ftLib;
-    FT_Face face;
-    static cList<cOglFont> *fonts;
-    mutable cList<cOglGlyph> glyphCache;
-    cOglFont(const char *fontName, int charHeight);
-    static void Init(void);
+    FT_Face face;                   // shared by all sizes of the font file
+    FT_Size ftSize;
+    FT_Stroker stroker;
+    static cMutex handleMutex;
+    static std::map<std::pair<std::string, int>, int> handleIndex;
+    static std::deque<sOglFontHandle> handles;     // grows only, so entries keep their address
+    mutable cOglGlyph *glyphDirect[OGL_GLYPH_DIRECT];
+    mutable std::vector<sOglGlyphSlot> glyphTable;
+    mutable int glyphCount;
+    bool hasKerning;
+    mutable std::unordered_map<uint64_t, int> kerningTable;    // keyed by both glyph indices
+    cOglGlyphCache *diskCache;
+    cOglFontMetrics *metrics;
+    cOglFont(const char *fontName, int charHeight, cOglFontMetrics *metrics);
+    cOglGlyph *FindGlyph(uint charCode) const;
+    void AddGlyph(cOglGlyph *glyph) const;
 public:
     virtual ~cOglFont(void);
-    static cOglFont *Get(const char *name, int charHeight);
+    static int Handle(const char *name, int charHeight);
+    static cOglFont *Get(int handle);
+    static int Width(int handle, const uint *symbols);
+    static cOglFaceLoader *SetFaceLoader(cOglFaceLoader *loader);
     static void Cleanup(void);
     const char *Name(void) { return *name; };
     int Size(void) { return size; };
     int Bottom(void) {return bottom; };
     int Height(void) {return height; };
     cOglGlyph* Glyph(uint charCode) const;
-    int Kerning(cOglGlyph *glyph, uint prevSym) const;
+    FT_Glyph Rasterize(FT_UInt glyphIndex) const;
+    void Reload(cOglGlyph *glyph) const;
+    bool Provides(uint charCode) const { return face && FT_Get_Char_Index(face, charCode) != 0; };
+    void SaveGlyphs(void) { if (diskCache) diskCache->Save(); };
+    int Kerning(cOglGlyph *glyph, cOglGlyph *prevGlyph) const;
 };
 
 /****************************************************************************************
@@ -164,16 +444,28 @@ public:
 class cOglFb {
 protected:
     bool initiated;
+    bool complete;      // fb and texture may be handed to the pool
     GLuint fb;
     GLuint texture;
     GLint width, height;
     GLint viewPortWidth, viewPortHeight;
     bool scrollable;
+    bool hidden;
+    bool evicted;
+    GLubyte *backup;
+    uint64_t lastUsed;
+    void Restore(void);
 public:
     cOglFb(GLint width, GLint height, GLint viewPortWidth, GLint viewPortHeight);
     virtual ~cOglFb(void);
     bool Initiated(void) { return initiated; }
     virtual bool Init(void);
+    bool Evict(void);
+    bool Evicted(void) { return evicted; };
+    void SetHidden(bool hidden) { this->hidden = hidden; };
+    bool Hidden(void) { return hidden; };
+    long Size(void) { return (long)width * height * 4; };
+    uint64_t LastUsed(void) { return lastUsed; };
     void Bind(void);
     void BindRead(void);
     virtual void BindWrite(void);
@@ -187,31 +479,263 @@ public:
     GLint ViewportHeight(void) { return viewPortHeight; };
 };
 
+/****************************************************************************************
+* cOglFbPool
+* Pool of initialized but unused framebuffer objects, recycled by size
+****************************************************************************************/
+#define OGL_FBPOOL_MAX_SIZE 32      // maximum size of pooled framebuffers in MB
+#define OGL_FBPOOL_MAX_AGE 30000    // pooled framebuffers unused for this long (ms) get deleted
+
+struct sOglPooledFb {
+    GLuint fb;
+    GLuint texture;
+    uint64_t lastUsed;
+};
+
+class cOglFbPool {
+private:
+    std::map<uint64_t, std::vector<sOglPooledFb> > buckets;
+    long memPooled;
+    long maxPoolSize;
+    int maxAge;
+    int hits;
+    int misses;
+    cTimeMs trimTimer;
+    static uint64_t Key(GLint width, GLint height) { return ((uint64_t)width << 32) | (uint32_t)height; };
+    static long Size(uint64_t key) { return (long)(key >> 32) * (long)(key & 0xFFFFFFFF) * 4; };
+    bool DeleteOldest(void);
+public:
+    cOglFbPool(long maxPoolSize, int maxAge);
+    virtual ~cOglFbPool(void);
+    bool Get(GLint width, GLint height, GLuint &fb, GLuint &texture);
+    bool Put(GLint width, GLint height, GLuint fb, GLuint texture);
+    bool Shrink(void) { return DeleteOldest(); };
+    void Trim(void);
+    void Clear(void);
+    long MemPooled(void) { return memPooled; };
+    int Hits(void) { return hits; };
+    int Misses(void) { return misses; };
+};
+
+/****************************************************************************************
+* cOglFbMemory
+* Accounting of framebuffer memory, evicts hidden framebuffers if over budget
+****************************************************************************************/
+#define OGL_FBMEMORY_MIN_IDLE 2000  // hidden framebuffers used within this time (ms) are not evicted
+
+class cOglFbMemory {
+private:
+    std::vector<cOglFb *> fbs;
+    cOglFb *restored;
+    long memUsed;
+    long memPeak;
+    long maxMemSize;
+    int evictions;
+    int restores;
+    bool warned;
+public:
+    cOglFbMemory(long maxMemSize);
+    virtual ~cOglFbMemory(void);
+    void Add(cOglFb *fb);
+    void Remove(cOglFb *fb);
+    void Restored(cOglFb *fb);
+    void Enforce(void);
+    long MemUsed(void) { return memUsed; };
+    long MemPeak(void) { return memPeak; };
+    int Evictions(void) { return evictions; };
+    int Restores(void) { return restores; };
+};
+
+/****************************************************************************************
+* cOglTextureCache
+* LRU cache of textures drawn by cOglPixmap::DrawImage(), keyed by a hash of their content
+****************************************************************************************/
+#define OGL_TEXCACHE_MAX_SIZE 16    // MB
+
+struct sOglCachedTexture {
+    GLuint texture;
+    GLint width;
+    GLint height;
+    int pins;
+    uint64_t lastUsed;
+};
+
+class cOglTextureCache {
+private:
+    cMutex mutex;
+    std::map<uint64_t, sOglCachedTexture> textures;
+    long memUsed;
+    long maxMemSize;
+    uint64_t tick;
+    int hits;
+    int misses;
+    long uploaded;
+    bool Evict(void);
+public:
+    cOglTextureCache(long maxMemSize);
+    virtual ~cOglTextureCache(void) {};
+    static uint64_t Key(const tColor *argb, int width, int height);
+    bool Cacheable(int width, int height) { return width * height * (long)sizeof(tColor) <= maxMemSize; };
+    GLuint Acquire(uint64_t key, int width, int height);
+    void Release(uint64_t key);
+    bool Insert(uint64_t key, GLuint texture, int width, int height);
+    void Clear(void);
+    void LogStats(void);
+};
+
+/****************************************************************************************
+* cOglTextLayoutCache
+* LRU cache of decoded strings and their glyph positions, keyed by font handle and text
+****************************************************************************************/
+#define OGL_TEXTLAYOUT_MAX_ENTRIES 512
+
+struct sOglGlyphPos {
+    cOglGlyph *glyph;
+    int pen;                        // x of the glyph without kerning, relative to the text
+    int kerning;
+};
+
+struct sOglTextLayout {
+    int font;
+    std::string text;
+    std::vector<uint> symbols;
+    int width;                      // advance of the whole text, as drawn
+    bool laidOut;                   // glyphs are set up by the worker thread on first use
+    std::vector<sOglGlyphPos> glyphs;
+};
+
+class cOglTextLayoutCache {
+private:
+    cMutex mutex;
+    std::list<std::shared_ptr<sOglTextLayout> > layouts;   // most recently used first
+    std::unordered_multimap<uint64_t, std::list<std::shared_ptr<sOglTextLayout> >::iterator> index;
+    int hits;
+    int misses;
+    long buildTime;                 // us spent on decoding and measuring missed strings
+    static uint64_t Key(int font, const char *text);
+public:
+    cOglTextLayoutCache(void);
+    virtual ~cOglTextLayoutCache(void) {};
+    std::shared_ptr<sOglTextLayout> Get(int font, const char *text);
+    void LogStats(void);
+};
+
 /****************************************************************************************
 * cOglOutputFb
-* Output Framebuffer Object - holds Vdpau Output Surface which is our "output framebuffer"
+* Output Framebuffer Object - base of the backends handing the osd over to the output device
 ****************************************************************************************/
+#define OGL_OUTPUT_SURFACES 2
+#define OGL_READBACK_POLL 1     // ms to wait for a readback before the command is requeued
+
+struct sOglOutputSource {
+    cOglFb *fb;
+    GLint x, y;
+    int pending;    // bit mask of the surfaces which lack the latest content
+};
+
+struct sOglOutputClear {
+    GLint x, y, width, height;
+    int pending;    // bit mask of the surfaces still showing the area
+};
+
 class cOglOutputFb : public cOglFb {
-private:
-    GLvdpauSurfaceNV surface;
+protected:
+    GLuint textures[OGL_OUTPUT_SURFACES];
+    GLuint fbs[OGL_OUTPUT_SURFACES];
+    int numSurfaces;
+    int back;
+    std::vector<sOglOutputSource> sources;
+    std::vector<sOglOutputClear> clears;
+    const char *name;
+    int frames;
+    uint64_t frameTime;
+    void AllocTextures(void);
+    bool InitFramebuffers(void);
+    void SelectSurface(int index);
 public:
-    cOglOutputFb(GLint width, GLint height);
+    cOglOutputFb(const char *name, GLint width, GLint height);
     virtual ~cOglOutputFb(void);
+    static cOglOutputFb *Create(int backend, GLint width, GLint height);
+    const char *Name(void) { return name; };
+    virtual bool Init(void) = 0;
+    virtual void BindWrite(void);
+    virtual void Unbind(void);
+    virtual void Present(void) = 0;
+    virtual bool Finish(void) { return true; };  // false while an asynchronous Present() is in flight
+    void SetSource(cOglFb *fb, GLint x, GLint y);
+    void RemoveSource(cOglFb *fb);
+    void ClearRemoved(void);
+    std::vector<sOglOutputSource> &Sources(void) { return sources; };
+    int Back(void) { return back; };
+    void FrameDone(uint64_t start);
+};
+
+class cOglOutputFbVdpau : public cOglOutputFb {
+private:
+    GLvdpauSurfaceNV surfaces[OGL_OUTPUT_SURFACES];
+    bool mapped;
+    int contextSwitches;
+    void ReleaseContext(void);
+    void AcquireContext(void);
+public:
+    cOglOutputFbVdpau(GLint width, GLint height);
+    virtual ~cOglOutputFbVdpau(void);
     virtual bool Init(void);
     virtual void BindWrite(void);
     virtual void Unbind(void);
+    virtual void Present(void);
+};
+
+#ifdef USE_GLES2
+class cOglOutputFbDmaBuf : public cOglOutputFb {
+private:
+    EGLImageKHR images[OGL_OUTPUT_SURFACES];
+    int fds[OGL_OUTPUT_SURFACES];
+    EGLint strides[OGL_OUTPUT_SURFACES];
+    EGLint offsets[OGL_OUTPUT_SURFACES];
+    int fourcc;
+    EGLuint64KHR modifier;
+public:
+    cOglOutputFbDmaBuf(GLint width, GLint height);
+    virtual ~cOglOutputFbDmaBuf(void);
+    virtual bool Init(void);
+    virtual void Present(void);
+};
+#endif
+
+class cOglOutputFbReadback : public cOglOutputFb {
+private:
+#ifdef USE_GLES2
+    tColor *pixels;
+#else
+    GLuint pbos[2];
+    GLsync fences[2];
+    int first;
+    int inFlight;
+    void Deliver(void);
+#endif
+public:
+    cOglOutputFbReadback(GLint width, GLint height);
+    virtual ~cOglOutputFbReadback(void);
+    virtual bool Init(void);
+    virtual void Present(void);
+    virtual bool Finish(void);
 };
 
 /****************************************************************************************
 * cOglVb
 * Vertex Buffer - OpenGl Vertices for the different drawing commands  
 ****************************************************************************************/
+#define OGL_PIXELBATCH_SIZE 16384   // maximum number of pixels drawn with one command
+
 enum eVertexBufferType {
     vbRect,
     vbEllipse,
     vbSlope,
     vbTexture,
     vbText,
+    vbPixel,
+    vbPalette,
     vbCount
 };
 
@@ -219,6 +743,7 @@ class cOglVb {
 private:
     eVertexBufferType type;
     eShaderType shader;
+    int variant;
     GLuint vao;
     GLuint vbo;
     GLuint positionLoc;
@@ -233,7 +758,7 @@ public:
     bool Init(void);
     void Bind(void);
     void Unbind(void);
-    void ActivateShader(void);
+    void ActivateShader(GLint alpha = 255, bool border = false);
     void EnableBlending(void);
     void DisableBlending(void);
     void SetShaderColor(GLint color);
@@ -242,6 +767,7 @@ public:
     void SetShaderTexture(GLint value);
 #endif
     void SetShaderAlpha(GLint alpha);
+    void SetShaderPalette(bool overlay, bool filter = false, GLint width = 0, GLint height = 0);
     void SetShaderProjectionMatrix(GLint width, GLint height);
     void SetVertexData(GLfloat *vertices, int count = 0);
     void DrawArrays(int count = 0);
@@ -258,6 +784,10 @@ public:
     virtual ~cOglCmd(void) {};
     virtual const char* Description(void) = 0;
     virtual bool Execute(void) = 0;
+    virtual bool Pending(void) { return false; };   // requeue, Execute() continues later
+    virtual bool Ordered(void) { return false; };   // while pending, later commands using its framebuffers wait
+    cOglFb *Fb(void) { return fb; };
+    virtual cOglFb *SecondFb(void) { return NULL; };    // read or written besides fb
 };
 
 class cOglCmdInitOutputFb : public cOglCmd {
@@ -288,6 +818,16 @@ public:
     virtual bool Execute(void);
 };
 
+class cOglCmdSetFbHidden : public cOglCmd {
+private:
+    bool hidden;
+public:
+    cOglCmdSetFbHidden(cOglFb *fb, bool hidden);
+    virtual ~cOglCmdSetFbHidden(void) {};
+    virtual const char* Description(void) { return "SetFramebufferHidden"; }
+    virtual bool Execute(void);
+};
+
 class cOglCmdRenderFbToBufferFb : public cOglCmd {
 private:
     cOglFb *buffer;
@@ -302,6 +842,23 @@ public:
     virtual ~cOglCmdRenderFbToBufferFb(void) {};
     virtual const char* Description(void) { return "Render Framebuffer to Buffer"; }
     virtual bool Execute(void);
+    virtual cOglFb *SecondFb(void) { return buffer; };
+};
+
+class cOglCmdCopyFb : public cOglCmd {
+private:
+    cOglFb *source;
+    GLint sx, sy;
+    GLint width, height;
+    GLint dx, dy;
+    bool blend;
+    bool CopyRect(cOglFb *src, GLint srcX, GLint srcY, cOglFb *dst, GLint dstX, GLint dstY);
+public:
+    cOglCmdCopyFb(cOglFb *fb, cOglFb *source, GLint sx, GLint sy, GLint width, GLint height, GLint dx, GLint dy, bool blend);
+    virtual ~cOglCmdCopyFb(void) {};
+    virtual const char* Description(void) { return "Copy Framebuffer"; }
+    virtual bool Execute(void);
+    virtual cOglFb *SecondFb(void) { return source; };
 };
 
 class cOglCmdCopyBufferToOutputFb : public cOglCmd {
@@ -313,11 +870,15 @@ private:
 #else
     GLint x, y;
 #endif
+    bool presented;
+    bool finished;
+    uint64_t start;
 public:
     cOglCmdCopyBufferToOutputFb(cOglFb *fb, cOglOutputFb *oFb, GLint x, GLint y);
     virtual ~cOglCmdCopyBufferToOutputFb(void) {};
     virtual const char* Description(void) { return "Copy buffer to OutputFramebuffer"; }
     virtual bool Execute(void);
+    virtual bool Pending(void) { return presented && !finished; };
 };
 
 class cOglCmdFill : public cOglCmd {
@@ -371,35 +932,87 @@ public:
     virtual bool Execute(void);
 };
 
+class cOglCmdDrawPixels : public cOglCmd {
+private:
+    std::vector<GLfloat> vertices;
+public:
+    cOglCmdDrawPixels(cOglFb *fb, std::vector<GLfloat> &vertices);
+    virtual ~cOglCmdDrawPixels(void) {};
+    virtual const char* Description(void) { return "DrawPixels"; }
+    virtual bool Execute(void);
+};
+
 class cOglCmdDrawText : public cOglCmd {
 private:
     GLint x, y;
     GLint limitX;
     GLint colorText;
-    cString fontName;
-    int fontSize;
-    unsigned int *symbols;
+    std::shared_ptr<sOglTextLayout> layout;
+    void Layout(cOglFont *font);
 public:
-    cOglCmdDrawText(cOglFb *fb, GLint x, GLint y, unsigned int *symbols, GLint limitX, const char *name, int fontSize, tColor colorText);
-    virtual ~cOglCmdDrawText(void);
+    cOglCmdDrawText(cOglFb *fb, GLint x, GLint y, std::shared_ptr<sOglTextLayout> layout, GLint limitX, tColor colorText);
+    virtual ~cOglCmdDrawText(void) {};
     virtual const char* Description(void) { return "DrawText"; }
     virtual bool Execute(void);
 };
 
 class cOglCmdDrawImage : public cOglCmd {
 private:
-    tColor *argb;
+    std::shared_ptr<const tColor> argb;
     GLint x, y, width, height;
     bool overlay;
     GLfloat scaleX, scaleY;
+    cOglTextureCache *cache;
+    uint64_t cacheKey;
+    GLuint cachedTexture;
+    GLuint texture;
+    GLint row;          // uploaded so far
 #ifdef USE_GLES2
     GLint bcolor;
 #endif
 public:
-    cOglCmdDrawImage(cOglFb *fb, tColor *argb, GLint width, GLint height, GLint x, GLint y, bool overlay = true, double scaleX = 1.0f, double scaleY = 1.0f);
-    virtual ~cOglCmdDrawImage(void);
+    cOglCmdDrawImage(cOglFb *fb, std::shared_ptr<const tColor> argb, GLint width, GLint height, GLint x, GLint y, bool overlay = true, double scaleX = 1.0f, double scaleY = 1.0f);
+    cOglCmdDrawImage(cOglFb *fb, cOglTextureCache *cache, uint64_t cacheKey, GLuint cachedTexture, GLint width, GLint height, GLint x, GLint y);
+    virtual ~cOglCmdDrawImage(void) {};
+    void SetCacheKey(cOglTextureCache *cache, uint64_t cacheKey) { this->cache = cache; this->cacheKey = cacheKey; };
     virtual const char* Description(void) { return "Draw Image"; }
     virtual bool Execute(void);
+    virtual bool Pending(void) { return cachedTexture == GL_NONE && row < height; };
+    virtual bool Ordered(void) { return true; };
+};
+
+//index and palette texture of a bitmap region which is redrawn regularly, e.g. subtitles
+struct sOglBitmapTextures {
+    GLuint textures[2];
+    GLint width;
+    GLint height;
+};
+
+class cOglCmdDrawBitmap : public cOglCmd {
+private:
+    tIndex *indices;
+    tColor *palette;
+    GLint x, y, width, height;
+    bool overlay;
+    GLfloat scaleX, scaleY;
+    bool filter;
+    sOglBitmapTextures *bitmapTextures;
+public:
+    cOglCmdDrawBitmap(cOglFb *fb, tIndex *indices, tColor *palette, GLint width, GLint height, GLint x, GLint y, bool overlay = false,
+                      double scaleX = 1.0f, double scaleY = 1.0f, bool filter = false, sOglBitmapTextures *bitmapTextures = NULL);
+    virtual ~cOglCmdDrawBitmap(void);
+    virtual const char* Description(void) { return "Draw Bitmap"; }
+    virtual bool Execute(void);
+};
+
+class cOglCmdDeleteBitmapTextures : public cOglCmd {
+private:
+    std::vector<sOglBitmapTextures *> bitmapTextures;
+public:
+    cOglCmdDeleteBitmapTextures(std::vector<sOglBitmapTextures *> &bitmapTextures);
+    virtual ~cOglCmdDeleteBitmapTextures(void) {};
+    virtual const char* Description(void) { return "Delete Bitmap Textures"; }
+    virtual bool Execute(void);
 };
 
 class cOglCmdDrawTexture : public cOglCmd {
@@ -419,30 +1032,109 @@ public:
 class cOglCmdStoreImage : public cOglCmd {
 private:
     sOglImage *imageRef;
-    tColor *data;
+    const tColor *data;
+    cCondWait *wait;
+    GLint row;
 public:
-    cOglCmdStoreImage(sOglImage *imageRef, tColor *argb);
-    virtual ~cOglCmdStoreImage(void);
+    cOglCmdStoreImage(sOglImage *imageRef, const tColor *argb, cCondWait *wait);
+    virtual ~cOglCmdStoreImage(void) {};
     virtual const char* Description(void) { return "Store Image"; }
     virtual bool Execute(void);
+    virtual bool Pending(void) { return row < imageRef->height; };
+};
+
+class cOglCmdEvictImage : public cOglCmd {
+private:
+    sOglImage *imageRef;
+    tColor *backup;     // allocated before the eviction was accounted for
+    bool deferred;
+public:
+    cOglCmdEvictImage(sOglImage *imageRef, tColor *backup);
+    virtual ~cOglCmdEvictImage(void) { free(backup); };
+    virtual const char* Description(void) { return "Evict Image"; }
+    virtual bool Execute(void);
+    virtual bool Pending(void) { return deferred; };
+};
+
+struct sOglEncodedImage {
+    GLenum internalFormat;
+    GLenum format;
+    GLenum type;
+    GLubyte *data;
+    long size;
+    bool compressed;
+};
+
+class cOglCmdReplaceImage : public cOglCmd {
+private:
+    sOglImage *imageRef;
+    sOglEncodedImage image;
+public:
+    cOglCmdReplaceImage(sOglImage *imageRef, const sOglEncodedImage &image);
+    virtual ~cOglCmdReplaceImage(void);
+    virtual const char* Description(void) { return "Replace Image"; }
+    virtual bool Execute(void);
 };
 
 class cOglCmdDropImage : public cOglCmd {
 private:
     sOglImage *imageRef;
     cCondWait *wait;
+    bool deferred;
 public:
     cOglCmdDropImage(sOglImage *imageRef, cCondWait *wait);
     virtual ~cOglCmdDropImage(void) {};
     virtual const char* Description(void) { return "Drop Image"; }
     virtual bool Execute(void);
+    virtual bool Pending(void) { return deferred; };
+};
+
+/******************************************************************************
+* cOglImageEncoder
+* Converts stored images to smaller texture formats in the background
+******************************************************************************/
+enum eOglImageStorage {
+    isReducedDepth = 1 << 0,    // RGB565 or RGBA4444, if lossless
+    isEtc1         = 1 << 1     // ETC1 for opaque images, if supported by the GLES driver
+};
+
+struct sOglEncodeJob {
+    int slot;
+    int serial;
+    tColor *argb;
+    int width;
+    int height;
+};
+
+class cOglThread;
+
+class cOglImageEncoder : public cThread {
+private:
+    cOglThread *oglThread;
+    int storage;
+    cCondWait wait;
+    std::queue<sOglEncodeJob> jobs;
+    void Encode(const sOglEncodeJob &job);
+protected:
+    virtual void Action(void);
+public:
+    cOglImageEncoder(cOglThread *oglThread, int storage);
+    virtual ~cOglImageEncoder(void);
+    void Add(int slot, int serial, tColor *argb, int width, int height);
 };
 
 /******************************************************************************
 * cOglThread
 ******************************************************************************/
-#define OGL_MAX_OSDIMAGES 256
 #define OGL_CMDQUEUE_SIZE 100
+#define OGL_MAX_BITMAP_REGIONS 8
+#define OGL_PREWARM_TIMESLICE 2     // ms of glyph pre-warming between checks for new commands
+
+struct sOglPrewarmRange {
+    int font;
+    uint first;
+    uint last;
+};
 
 class cOglThread : public cThread {
 private:
@@ -450,30 +1142,67 @@ private:
     cCondWait *wait;
     bool stalled;
     std::queue<cOglCmd*> commands;
+    std::set<cOglCmd*> ordered;         // pending commands later ones on their framebuffers wait for
+    std::set<cOglFb*> blockedFbs;
+    std::deque<cOglCmd*> held;          // waiting, in queue order
     GLint maxTextureSize;
-    sOglImage imageCache[OGL_MAX_OSDIMAGES];
+    bool paletteShader;
+    cMutex imageMutex;
+    std::deque<sOglImage> imageCache;
+    std::vector<int> freeSlots;
+    uint64_t imageTick;
+    int imageHits;
+    int imageEvictions;
+    int imageReuploads;
+    int imageStorage;
+    bool etc1Support;
+    cOglImageEncoder *imageEncoder;
+    int imagesEncoded;
+    long imageMemSaved;
+    cOglTextureCache *textureCache;
+    cOglTextLayoutCache *textLayouts;
     long memCached;
     long maxCacheSize;
+    long maxFbMemSize;
+    int outputBackend;
+    std::vector<sOglPrewarmRange> prewarmRanges;
+    size_t prewarmRange;
+    uint prewarmChar;
+    int prewarmGlyphs;
+    int prewarmTime;
     bool InitOpenGL(void);
     bool InitShaders(void);
     void DeleteShaders(void);
     bool InitVdpauInterop(void);
+    bool InitOutput(void);
     bool InitVertexBuffers(void);
     void DeleteVertexBuffers(void);
     void Cleanup(void);
-    int GetFreeSlot(void);
+    int GetFreeSlot(int width, int height);
     void ClearSlot(int slot);
+    bool EvictImages(long needed);
+    void InitPrewarm(void);
+    bool PrewarmGlyphs(void);
+    bool Blocked(cOglCmd *cmd);
+    void Hold(cOglCmd *cmd);
 protected:
     virtual void Action(void);
 public:
-    cOglThread(cCondWait *startWait, int maxCacheSize);
+    cOglThread(cCondWait *startWait, int maxCacheSize, int maxFbMemSize = 0, int imageStorage = 0, int outputBackend = obVdpau);
     virtual ~cOglThread();
     void Stop(void);
     void DoCmd(cOglCmd* cmd);
     int StoreImage(const cImage &image);
     void DropImageData(int imageHandle);
     sOglImage *GetImageRef(int slot);
+    sOglImage *UseImage(int imageHandle);
+    void ReplaceImage(int slot, int serial, const sOglEncodedImage &image);
+    bool Etc1Support(void) { return etc1Support; };
     int MaxTextureSize(void) { return maxTextureSize; };
+    int OutputBackend(void) { return outputBackend; };
+    bool PaletteShader(void) { return paletteShader; };
+    cOglTextureCache *TextureCache(void) { return textureCache; };
+    cOglTextLayoutCache *TextLayouts(void) { return textLayouts; };
 };
 
 /****************************************************************************************
@@ -484,14 +1213,20 @@ private:
     cOglFb *fb;
     std::shared_ptr<cOglThread> oglThread;
     bool dirty;
+    bool hidden;
+    mutable std::vector<GLfloat> pixels;
+    void UpdateHidden(void);
+    void DrawImageData(const cPoint &Point, std::shared_ptr<const tColor> argb, int Width, int Height);
 public:
     cOglPixmap(std::shared_ptr<cOglThread> oglThread, int Layer, const cRect &ViewPort, const cRect &DrawPort = cRect::Null);
     virtual ~cOglPixmap(void);
-    cOglFb *Fb(void) { return fb; };
+    cOglFb *Fb(void) const { return fb; };
     int X(void) { return ViewPort().X(); };
     int Y(void) { return ViewPort().Y(); };
     virtual bool IsDirty(void) { return dirty; }
     virtual void SetDirty(bool dirty = true) { this->dirty = dirty; }
+    void FlushPixels(void) const;
+    virtual void SetLayer(int Layer);
     virtual void SetAlpha(int Alpha);
     virtual void SetTile(bool Tile);
     virtual void SetViewPort(const cRect &Rect);
@@ -502,6 +1237,7 @@ public:
     virtual void DrawImage(const cPoint &Point, int ImageHandle);
     virtual void DrawPixel(const cPoint &Point, tColor Color);
     virtual void DrawBitmap(const cPoint &Point, const cBitmap &Bitmap, tColor ColorFg = 0, tColor ColorBg = 0, bool Overlay = false);
+    bool DrawScaledBitmap(const cPoint &Point, const cBitmap &Bitmap, double FactorX, double FactorY, bool AntiAlias, sOglBitmapTextures *bitmapTextures = NULL);
     virtual void DrawText(const cPoint &Point, const char *s, tColor ColorFg, tColor ColorBg, const cFont *Font, int Width = 0, int Height = 0, int Alignment = taDefault);
     virtual void DrawRectangle(const cRect &Rect, tColor Color);
     virtual void DrawEllipse(const cRect &Rect, tColor Color, int Quadrants = 0);
@@ -521,6 +1257,8 @@ private:
     std::shared_ptr<cOglThread> oglThread;
     cVector<cOglPixmap *> oglPixmaps;
     bool isSubtitleOsd;
+    std::map<uint64_t, sOglBitmapTextures *> bitmapTextures;
+    void DeleteBitmapTextures(void);
 protected:
 public:
     cOglOsd(int Left, int Top, uint Level, std::shared_ptr<cOglThread> oglThread);